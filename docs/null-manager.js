@@ -73,9 +73,9 @@ export default class NullManager {
   }
 
   // set a param of a unit
-  set_param(unitId, paramId, value) {
+  set_param(unitId, paramId, value, timefromNowInSeconds=0) {
     if (this.units[unitId] && this.units[unitId].set_param) {
-      this.units[unitId].set_param(paramId, value)
+      this.units[unitId].set_param(paramId, value, timefromNowInSeconds)
     }
   }
 
@@ -7,6 +7,19 @@ const NULL_PARAM_BOOL = 0
 const NULL_PARAM_I32 = 1
 const NULL_PARAM_F32 = 2
 
+// view a sample (typed-array or ArrayBuffer) as floats, without copying it
+function sampleFloats (sample) {
+  if (!sample) {
+    return
+  }
+  if (sample instanceof ArrayBuffer) {
+    return new Float32Array(sample, 0, sample.byteLength >> 2)
+  }
+  if (sample.buffer) {
+    return new Float32Array(sample.buffer, sample.byteOffset, sample.byteLength >> 2)
+  }
+}
+
 // fully loads the wasm
 async function setupWasm(bytes, wrapper) {
   const wasi_snapshot_preview1 = new EasyWasiLite()
@@ -23,12 +36,31 @@ async function setupWasm(bytes, wrapper) {
         console.log(wasi_snapshot_preview1.getString(msgPtr))
       },
 
+      // offset is in bytes (as it always was here, and on native host), length is in floats
+      // (copied straight out of sample, no slice in between)
       get_data_floats (id, offset, length, out) {
-        if (!wrapper.data[id]?.buffer) {
+        const sample = sampleFloats(wrapper.data[id])
+        if (!sample) {
           return
         }
-        const mem = new Uint8Array(wasm.memory.buffer)
-        mem.set(new Uint8Array(wrapper.data[id].buffer.slice(offset, offset + (length * 4))), out)
+        const start = offset >>> 2
+        const dest = new Float32Array(wasm.memory.buffer, out, length)
+        const src = sample.subarray(Math.min(start, sample.length), start + length)
+        dest.set(src)
+        dest.fill(0, src.length)
+      },
+
+      // samples can't be shared into unit memory here, so units use get_data_floats
+      get_data_ptr (id) {
+        return 0
+      },
+
+      get_data_length (id) {
+        return sampleFloats(wrapper.data[id])?.length || 0
+      },
+
+      get_data_channels (id) {
+        return wrapper.data[id] ? (wrapper.data[id].channels || 1) : 0
       }
     }
   }
@@ -88,6 +120,8 @@ class NullUnitProcessor extends AudioWorkletProcessor {
     this.unitID = 0
     this.info = {}
     this.data = {}
+    this.blockSize = 0
+    this.events = []
 
     this.port.onmessage = async ({ data: { type, ...args } }) => {
       switch (type) {
@@ -103,19 +137,14 @@ class NullUnitProcessor extends AudioWorkletProcessor {
           this.data[index] = sample
           break
         case 'param_set':
-          const { id, paramID, value } = args
-          this.info.params[paramID].value = value
-          const view = new DataView(this.wasm.memory.buffer, this.paramPtr, 4)
-          if (this.info.params[paramID].type == NULL_PARAM_F32) {
-            view.setFloat32(0, value, true)
-          }
-          if (this.info.params[paramID].type == NULL_PARAM_I32) {
-            view.setInt32(0, value, true)
-          }
-          if (this.info.params[paramID].type == NULL_PARAM_BOOL) {
-            view.setInt32(0, value ? 1 : 0, true)
+          const { paramID, value, time } = args
+          // time is absolute (context) time, so it can land on the exact frame in process()
+          if (!time || time <= currentTime) {
+            this.setParam(paramID, value)
+          } else {
+            const at = this.events.findIndex(e => e.time > time)
+            this.events.splice(at === -1 ? this.events.length : at, 0, { time, paramID, value })
           }
-          this.wasm.param_set(paramID, this.paramPtr)
           break
         default:
           console.log('unhandled message', { type, args })
@@ -123,17 +152,83 @@ class NullUnitProcessor extends AudioWorkletProcessor {
     }
   }
 
-  process (inputs, outputs) {
-    if (!this?.wasm?.process) return true
+  // set a param in the unit
+  setParam (paramID, value) {
+    this.info.params[paramID].value = value
+    const view = new DataView(this.wasm.memory.buffer, this.paramPtr, 4)
+    if (this.info.params[paramID].type == NULL_PARAM_F32) {
+      view.setFloat32(0, value, true)
+    }
+    if (this.info.params[paramID].type == NULL_PARAM_I32) {
+      view.setInt32(0, value, true)
+    }
+    if (this.info.params[paramID].type == NULL_PARAM_BOOL) {
+      view.setInt32(0, value ? 1 : 0, true)
+    }
+    this.wasm.param_set(paramID, this.paramPtr)
+  }
 
-    const output = outputs[0]
-    const input = inputs[0]
+  // apply scheduled params that are due at frame (of this block), and return frame of the next one
+  applyEvents (frame, frames) {
+    while (this.events.length && Math.round((this.events[0].time - currentTime) * sampleRate) <= frame) {
+      const { paramID, value } = this.events.shift()
+      this.setParam(paramID, value)
+    }
+    if (this.events.length) {
+      return Math.min(frames, Math.round((this.events[0].time - currentTime) * sampleRate))
+    }
+    return frames
+  }
+
+  // block ABI: copy input into unit memory (interleaved), call the unit once, copy output back
+  processBlock (input, output, start, end) {
+    const channels = output.length
+    const frames = end - start
+    const size = frames * channels
+    if (!size) return
 
+    // (re)allocate in/out buffers in unit memory
+    if (size > this.blockSize) {
+      if (this.blockIn) {
+        this.wasm.free(this.blockIn)
+        this.wasm.free(this.blockOut)
+      }
+      this.blockIn = this.wasm.malloc(size * 4)
+      this.blockOut = this.wasm.malloc(size * 4)
+      this.blockSize = size
+    }
+
+    let heap = new Float32Array(this.wasm.memory.buffer)
+    const inOffset = this.blockIn >> 2
+    for (let channel = 0; channel < channels; channel++) {
+      const inputChannel = input && input[channel] ? input[channel] : undefined
+      for (let i = 0; i < frames; i++) {
+        const inputValue = inputChannel ? inputChannel[start + i] : 0
+        heap[inOffset + (i * channels) + channel] = isNaN(inputValue) ? 0 : inputValue
+      }
+    }
+
+    this.wasm.process_block(this.blockIn, this.blockOut, frames, channels, sampleRate, currentTime + (start / sampleRate))
+
+    // memory may have grown (and detached the old buffer) during the call
+    heap = new Float32Array(this.wasm.memory.buffer)
+    const outOffset = this.blockOut >> 2
+    for (let channel = 0; channel < channels; channel++) {
+      const outputChannel = output[channel]
+      for (let i = 0; i < frames; i++) {
+        const processedValue = heap[outOffset + (i * channels) + channel]
+        outputChannel[start + i] = isNaN(processedValue) ? 0 : processedValue
+      }
+    }
+  }
+
+  // per-sample ABI: call the unit for every sample
+  processSamples (input, output, start, end) {
     for (let channel = 0; channel < output.length; channel++) {
       const outputChannel = output[channel]
       const inputChannel = input && input[channel] ? input[channel] : undefined
 
-      for (let i = 0; i < outputChannel.length; i++) {
+      for (let i = start; i < end; i++) {
         let inputValue = 0
         if (inputChannel && typeof inputChannel[i] === 'number' && !isNaN(inputChannel[i])) {
           inputValue = inputChannel[i]
@@ -143,6 +238,28 @@ class NullUnitProcessor extends AudioWorkletProcessor {
         outputChannel[i] = isNaN(processedValue) ? 0 : processedValue
       }
     }
+  }
+
+  process (inputs, outputs) {
+    if (!this?.wasm?.process) return true
+
+    const output = outputs[0]
+    const input = inputs[0]
+    const frames = output.length ? output[0].length : 128
+
+    // split the block at each scheduled param, so it lands on the exact frame
+    let start = 0
+    while (start < frames) {
+      const end = this.applyEvents(start, frames)
+
+      // units that export process_block get each part of the block in one call
+      if (this.wasm.process_block) {
+        this.processBlock(input, output, start, end)
+      } else {
+        this.processSamples(input, output, start, end)
+      }
+      start = end
+    }
     return true
   }
 }
@@ -75,9 +75,9 @@ export default class UnitWasm {
       }
     }
 
-    setTimeout(() => {
-      this.audioNode.port.postMessage({ id: this.id, type: 'param_set', paramID: pi, value })
-    }, timefromNowInSeconds * 1000)
+    // worklet applies it on the exact frame
+    const time = timefromNowInSeconds > 0 ? this.manager.audioCtx.currentTime + timefromNowInSeconds : 0
+    this.audioNode.port.postMessage({ id: this.id, type: 'param_set', paramID: pi, value, time })
   }
 
   // get a param
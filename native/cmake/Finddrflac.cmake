@@ -0,0 +1,14 @@
+# dr_flac (single-header FLAC decoder, from dr_libs), for loading .flac samples
+option(NULLUNIT_FLAC "Decode FLAC samples (fetches dr_flac)" ON)
+
+add_library(drflac INTERFACE)
+if (NULLUNIT_FLAC)
+  FetchContent_Declare(drlibs
+    URL https://github.com/mackron/dr_libs/archive/refs/heads/master.zip
+  )
+  FetchContent_MakeAvailable(drlibs)
+  target_include_directories(drflac INTERFACE ${drlibs_SOURCE_DIR})
+  target_compile_definitions(drflac INTERFACE NULL_FLAC=1)
+else()
+  target_compile_definitions(drflac INTERFACE NULL_FLAC=0)
+endif()
@@ -1,7 +1,33 @@
 string(TOLOWER ${CMAKE_HOST_SYSTEM_NAME} WAMR_BUILD_PLATFORM)
+
+# execution tiers (pick at runtime with --engine)
+# classic/fast interpreter is a build choice: WAMR only has one of them in a build
+option(NULLUNIT_FAST_INTERP "Use WAMR's fast interpreter, instead of the classic one" ON)
+option(NULLUNIT_AOT "Load AOT units (.aot made by wamrc, next to the .wasm)" ON)
+option(NULLUNIT_JIT "Build WAMR's LLVM JIT (needs LLVM, see WAMR docs)" OFF)
+option(NULLUNIT_FAST_JIT "Build WAMR's fast JIT" OFF)
+
 set (WAMR_BUILD_INTERP 1)
-set (WAMR_BUILD_FAST_INTERP 0)
-set (WAMR_BUILD_AOT 0)
+if (NULLUNIT_FAST_INTERP)
+  set (WAMR_BUILD_FAST_INTERP 1)
+else()
+  set (WAMR_BUILD_FAST_INTERP 0)
+endif()
+if (NULLUNIT_AOT)
+  set (WAMR_BUILD_AOT 1)
+else()
+  set (WAMR_BUILD_AOT 0)
+endif()
+if (NULLUNIT_JIT)
+  set (WAMR_BUILD_JIT 1)
+else()
+  set (WAMR_BUILD_JIT 0)
+endif()
+if (NULLUNIT_FAST_JIT)
+  set (WAMR_BUILD_FAST_JIT 1)
+else()
+  set (WAMR_BUILD_FAST_JIT 0)
+endif()
 set (WAMR_BUILD_LIBC_BUILTIN 1)
 set (WAMR_BUILD_LIBC_WASI 1)
 set (WAMR_BUILD_SIMD 1)
@@ -13,3 +39,23 @@ FetchContent_MakeAvailable(wamr)
 
 include (${wamr_SOURCE_DIR}/build-scripts/runtime_lib.cmake)
 add_library(wamr ${WAMR_RUNTIME_LIB_SOURCE})
+if (NULLUNIT_JIT)
+  target_link_libraries(wamr ${LLVM_AVAILABLE_LIBS})
+endif()
+
+# hardware bounds checks (WAMR has them on 64-bit targets, unless they are turned off): unit memory is reserved
+# up-front and doesn't move when it grows, so the audio bus and samples can be mapped into it
+if (NOT WAMR_DISABLE_HW_BOUND_CHECK EQUAL 1 AND WAMR_BUILD_TARGET MATCHES "^(X86_64|AMD_64|AARCH64.*|RISCV64.*)$" AND WAMR_BUILD_PLATFORM MATCHES "^(linux|darwin|freebsd|android)$")
+  set (NULL_WAMR_HW_BOUND_CHECK 1)
+else()
+  set (NULL_WAMR_HW_BOUND_CHECK 0)
+endif()
+
+# so the host knows which tiers it has (and how unit memory is laid out)
+target_compile_definitions(wamr INTERFACE
+  NULL_WAMR_FAST_INTERP=${WAMR_BUILD_FAST_INTERP}
+  NULL_WAMR_AOT=${WAMR_BUILD_AOT}
+  NULL_WAMR_JIT=${WAMR_BUILD_JIT}
+  NULL_WAMR_FAST_JIT=${WAMR_BUILD_FAST_JIT}
+  NULL_WAMR_HW_BOUND_CHECK=${NULL_WAMR_HW_BOUND_CHECK}
+)
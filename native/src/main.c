@@ -6,6 +6,11 @@
 static lo_server server = NULL;
 static lo_address client_address = NULL;
 static int keep_running = 1;
+static NullPatch* preloaded = NULL;
+static bool switch_pending = false;
+static float switch_fade = 0.0f;
+static double stats_rate = 0.0;
+static uint64_t stats_sent = 0;
 
 // Signal handler for Ctrl+C
 void signal_handler(int signum) {
@@ -17,6 +22,17 @@ void error_handler(int num, const char *msg, const char *path) {
   fprintf(stderr, "nullunit OSC server error %d in path %s: %s\n", num, path, msg);
 }
 
+// an OSC bundle is a batch: everything in it goes live together, with one compile
+int handle_bundle_start(lo_timetag time, void* managerPtr) {
+  null_manager_batch_begin((NullUnitManager*)managerPtr);
+  return 0;
+}
+
+int handle_bundle_end(void* managerPtr) {
+  null_manager_batch_end((NullUnitManager*)managerPtr);
+  return 0;
+}
+
 // Handler for /unit/load messages
 int handle_unit_load(const char *path, const char *types, lo_arg **argv, int argc, lo_message msg, void* managerPtr) {
   if (argc != 1) {
@@ -66,6 +82,24 @@ int handle_unit_connect(const char *path, const char *types, lo_arg **argv, int
   return 0;
 }
 
+// Handler for /unit/disconnect messages
+int handle_unit_disconnect(const char *path, const char *types, lo_arg **argv, int argc, lo_message msg, void* managerPtr) {
+  if (argc != 4) {
+    return 0;
+  }
+
+  unsigned int unitSourceId = argv[0]->i;
+  unsigned int unitSourcePort = argv[1]->i;
+  unsigned int unitDestinationId = argv[2]->i;
+  unsigned int unitDestinationPort = argv[3]->i;
+  printf("unit disconnect: %u %u %u %u\n", unitSourceId, unitSourcePort, unitDestinationId, unitDestinationPort);
+
+  NullUnitManager* manager = (NullUnitManager*)managerPtr;
+  null_manager_disconnect(manager, unitSourceId, unitSourcePort, unitDestinationId, unitDestinationPort);
+
+  return 0;
+}
+
 // Handler for /unit/param messages (int value)
 int handle_unit_param_i(const char *path, const char *types, lo_arg **argv, int argc, lo_message msg, void* managerPtr) {
   if (argc != 4) {
@@ -137,6 +171,273 @@ int handle_unit_param_f_notime(const char *path, const char *types, lo_arg **arg
   return 0;
 }
 
+// Handler for /unit/param/ramp messages (unit param target seconds [curve])
+// curve is "linear" (default) or "exponential" (or 0/1)
+int handle_unit_param_ramp(const char *path, const char *types, lo_arg **argv, int argc, lo_message msg, void* managerPtr) {
+  if (argc < 4) {
+    return 0;
+  }
+
+  unsigned int unitSourceId = argv[0]->i;
+  unsigned int paramId = argv[1]->i;
+  float target = argv[2]->f;
+  float seconds = argv[3]->f;
+  NullRampCurve curve = NULL_RAMP_LINEAR;
+  if (argc > 4 && types[4] == 'i' && argv[4]->i == 1) {
+    curve = NULL_RAMP_EXPONENTIAL;
+  }
+  if (argc > 4 && types[4] == 's' && strncmp(&argv[4]->s, "exp", 3) == 0) {
+    curve = NULL_RAMP_EXPONENTIAL;
+  }
+  printf("unit param ramp: %u %u %f %f %s\n", unitSourceId, paramId, target, seconds, curve == NULL_RAMP_EXPONENTIAL ? "exponential" : "linear");
+
+  NullUnitManager* manager = (NullUnitManager*)managerPtr;
+  null_manager_ramp_param(manager, unitSourceId, paramId, target, seconds, curve);
+
+  return 0;
+}
+
+// Handler for /voices/load messages (count steal name [name...]): a voice group of count voices, each a chain of units
+// steal is "oldest" or "quietest", replies with the group's id
+int handle_voices_load(const char *path, const char *types, lo_arg **argv, int argc, lo_message msg, void* managerPtr) {
+  if (argc < 3 || types[0] != 'i' || types[1] != 's') {
+    return 0;
+  }
+  unsigned int count = argv[0]->i;
+  NullVoiceSteal steal = strcmp(&argv[1]->s, "quietest") == 0 ? NULL_STEAL_QUIETEST : NULL_STEAL_OLDEST;
+  const char* names[argc - 2];
+  for (int i = 2; i < argc; i++) {
+    if (types[i] != 's') {
+      return 0;
+    }
+    names[i - 2] = &argv[i]->s;
+  }
+  printf("voices load: %u %s\n", count, steal == NULL_STEAL_QUIETEST ? "quietest" : "oldest");
+
+  NullUnitManager* manager = (NullUnitManager*)managerPtr;
+  unsigned int groupId = null_manager_voices(manager, names, argc - 2, count, steal);
+
+  return lo_send(client_address, "/voices/load", "i", groupId);
+}
+
+// Handler for /voices/note messages (group note velocity): velocity is 0-1 (float) or 0-127 (int), 0 stops the note
+int handle_voices_note(const char *path, const char *types, lo_arg **argv, int argc, lo_message msg, void* managerPtr) {
+  if (argc != 3) {
+    return 0;
+  }
+
+  unsigned int groupId = argv[0]->i;
+  unsigned int note = argv[1]->i;
+  float velocity = types[2] == 'i' ? argv[2]->i / 127.0f : argv[2]->f;
+  printf("voices note: %u %u %f\n", groupId, note, velocity);
+
+  NullUnitManager* manager = (NullUnitManager*)managerPtr;
+  null_manager_note(manager, groupId, note, velocity);
+
+  return 0;
+}
+
+// Handler for /voices/param messages (group position param value [time]): set a param in every voice
+int handle_voices_param(const char *path, const char *types, lo_arg **argv, int argc, lo_message msg, void* managerPtr) {
+  if (argc < 4) {
+    return 0;
+  }
+
+  unsigned int groupId = argv[0]->i;
+  unsigned int position = argv[1]->i;
+  unsigned int paramId = argv[2]->i;
+  NullUnitParamValue value = { .i=argv[3]->i };
+  if (types[3] == 'f') {
+    value.f = argv[3]->f;
+  }
+  float timefromNowInSeconds = argc > 4 ? argv[4]->f : 0.0f;
+  printf("voices param: %u %u %u %s %f\n", groupId, position, paramId, types[3] == 'f' ? "f" : "i", timefromNowInSeconds);
+
+  NullUnitManager* manager = (NullUnitManager*)managerPtr;
+  null_manager_voices_param(manager, groupId, position, paramId, value, timefromNowInSeconds);
+
+  return 0;
+}
+
+// preload thread: a bundle's /unit/load, /unit/connect and /unit/param, into a patch (it's not live, so no replies, and no times)
+int handle_patch_load(const char *path, const char *types, lo_arg **argv, int argc, lo_message msg, void* patchPtr) {
+  null_patch_load((NullPatch*)patchPtr, &argv[0]->s);
+  return 0;
+}
+
+int handle_patch_connect(const char *path, const char *types, lo_arg **argv, int argc, lo_message msg, void* patchPtr) {
+  null_patch_connect((NullPatch*)patchPtr, argv[0]->i, argv[1]->i, argv[2]->i, argv[3]->i);
+  return 0;
+}
+
+int handle_patch_param(const char *path, const char *types, lo_arg **argv, int argc, lo_message msg, void* patchPtr) {
+  NullUnitParamValue value = { .i=argv[2]->i };
+  if (types[2] == 'f') {
+    value.f = argv[2]->f;
+  }
+  null_patch_set_param((NullPatch*)patchPtr, argv[0]->i, argv[1]->i, value);
+  return 0;
+}
+
+// preload thread: run OSC data (a message, or a bundle of them) into a patch, false if it's not OSC
+// it's parsed right here, not through a server, so preloading doesn't need a socket
+static bool patch_dispatch(NullPatch* patch, unsigned char* data, size_t size) {
+  if (size >= 16 && memcmp(data, "#bundle", 8) == 0) {
+    // timetag, then elements: a big-endian size, and a message (or bundle)
+    size_t pos = 16;
+    while (pos + 4 <= size) {
+      uint32_t len = ((uint32_t)data[pos] << 24) | ((uint32_t)data[pos + 1] << 16) | ((uint32_t)data[pos + 2] << 8) | data[pos + 3];
+      pos += 4;
+      if (len > size - pos || !patch_dispatch(patch, data + pos, len)) {
+        return false;
+      }
+      pos += len;
+    }
+    return pos == size;
+  }
+
+  int result;
+  lo_message msg = lo_message_deserialise(data, size, &result);
+  if (msg == NULL) {
+    return false;
+  }
+  const char* path = (const char*)data;
+  const char* types = lo_message_get_types(msg);
+  lo_arg** argv = lo_message_get_argv(msg);
+  int argc = lo_message_get_argc(msg);
+  if (strcmp(path, "/unit/load") == 0 && strcmp(types, "s") == 0) {
+    handle_patch_load(path, types, argv, argc, msg, patch);
+  } else if (strcmp(path, "/unit/connect") == 0 && strcmp(types, "iiii") == 0) {
+    handle_patch_connect(path, types, argv, argc, msg, patch);
+  } else if (strcmp(path, "/unit/param") == 0 && (strcmp(types, "iiif") == 0 || strcmp(types, "iiff") == 0 || strcmp(types, "iii") == 0 || strcmp(types, "iif") == 0)) {
+    handle_patch_param(path, types, argv, argc, msg, patch);
+  }
+  lo_message_free(msg);
+  return true;
+}
+
+// preload thread: run a bundle file into a patch
+void patch_build(NullPatch* patch, void* filename) {
+  size_t size;
+  unsigned char* bytes = null_manager_map_file((char*)filename, &size, false, NULL);
+  if (bytes == NULL) {
+    fprintf(stderr, "Could not preload patch %s\n", (char*)filename);
+  } else if (!patch_dispatch(patch, bytes, size)) {
+    fprintf(stderr, "Could not run patch %s\n", (char*)filename);
+  }
+  null_manager_unmap_file(bytes, size);
+  printf("patch preloaded: %s\n", (char*)filename);
+  free(filename);
+}
+
+// Handler for /patch/preload messages: load a bundle in the background, to /patch/switch to
+int handle_patch_preload(const char *path, const char *types, lo_arg **argv, int argc, lo_message msg, void* managerPtr) {
+  char* filename = &argv[0]->s;
+  printf("patch preload: %s\n", filename);
+
+  // only one waits to be switched to
+  null_patch_free(preloaded);
+  switch_pending = false;
+  preloaded = null_patch_preload((NullUnitManager*)managerPtr, patch_build, strdup(filename));
+
+  return 0;
+}
+
+// Handler for /patch/switch messages ([crossfade seconds]): switch to preloaded patch, as soon as it's ready
+int handle_patch_switch(const char *path, const char *types, lo_arg **argv, int argc, lo_message msg, void* managerPtr) {
+  if (preloaded == NULL) {
+    fprintf(stderr, "No patch is preloaded\n");
+    return 0;
+  }
+  switch_fade = argc > 0 ? argv[0]->f : 0.0f;
+  switch_pending = true;
+  printf("patch switch: %f\n", switch_fade);
+
+  return 0;
+}
+
+// add a stats report to a message: blocks, mean us per block, load %, worst us, worst load %, then the histogram
+static void add_stats(lo_message reply, NullStatsReport* report) {
+  lo_message_add_int64(reply, (int64_t)report->blocks);
+  lo_message_add_float(reply, (float)(report->mean_ns / 1000.0));
+  lo_message_add_float(reply, (float)report->load);
+  lo_message_add_float(reply, (float)(report->worst_ns / 1000.0));
+  lo_message_add_float(reply, (float)report->worst_load);
+  for (int i = 0; i < NULL_STATS_BUCKETS; i++) {
+    lo_message_add_int32(reply, (int32_t)report->histogram[i]);
+  }
+}
+
+// send /stats for whole blocks, then /stats/unit (id name ...) for every loaded unit
+static void send_stats(NullUnitManager* manager) {
+  NullStatsReport report;
+  null_stats_read(&manager->stats, manager->sample_rate, &report);
+  lo_message reply = lo_message_new();
+  add_stats(reply, &report);
+  lo_send_message(client_address, "/stats", reply);
+  lo_message_free(reply);
+
+  for (size_t i = 1; i < cvector_size(manager->units); i++) {
+    NullUnit* unit = manager->units[i];
+    if (unit == NULL) {
+      continue;
+    }
+    null_stats_read(&unit->stats, manager->sample_rate, &report);
+    reply = lo_message_new();
+    lo_message_add_int32(reply, (int32_t)i);
+    lo_message_add_string(reply, unit->info->name);
+    add_stats(reply, &report);
+    lo_send_message(client_address, "/stats/unit", reply);
+    lo_message_free(reply);
+  }
+}
+
+// Handler for /stats messages: reply with DSP stats now
+int handle_stats(const char *path, const char *types, lo_arg **argv, int argc, lo_message msg, void* managerPtr) {
+  send_stats((NullUnitManager*)managerPtr);
+  return 0;
+}
+
+// Handler for /stats/rate messages (seconds): send stats that often, 0 to stop
+int handle_stats_rate(const char *path, const char *types, lo_arg **argv, int argc, lo_message msg, void* managerPtr) {
+  stats_rate = argv[0]->f > 0.0f ? argv[0]->f : 0.0;
+  printf("stats rate: %f\n", stats_rate);
+  return 0;
+}
+
+// Handler for /stats/reset messages: start stats over
+int handle_stats_reset(const char *path, const char *types, lo_arg **argv, int argc, lo_message msg, void* managerPtr) {
+  NullUnitManager* manager = (NullUnitManager*)managerPtr;
+  null_stats_reset(&manager->stats);
+  for (size_t i = 1; i < cvector_size(manager->units); i++) {
+    if (manager->units[i] != NULL) {
+      null_stats_reset(&manager->units[i]->stats);
+    }
+  }
+  return 0;
+}
+
+// Handler for /xruns messages: reply with /xruns (count, recent), then /xruns/event for each recent one, oldest first
+// (seconds, render ms, block ms, units, last command, its unit, seconds since it)
+int handle_xruns(const char *path, const char *types, lo_arg **argv, int argc, lo_message msg, void* managerPtr) {
+  NullUnitManager* manager = (NullUnitManager*)managerPtr;
+  null_xruns_collect(manager);
+  double rate = manager->sample_rate;
+  lo_send(client_address, "/xruns", "hi", (int64_t)atomic_load(&manager->xrun_count), manager->xrun_recent_count);
+  NullXrun* xrun;
+  for (unsigned int i = 0; (xrun = null_xrun_recent(manager, i)) != NULL; i++) {
+    lo_send(client_address, "/xruns/event", "fffisif",
+      (float)(xrun->frame / rate),
+      (float)(xrun->render_ns / 1e6),
+      (float)(xrun->render_frames * 1000.0 / rate),
+      (int)xrun->nodes,
+      null_command_name(xrun->command),
+      xrun->command_unit == NULL_UNIT_INVALID ? -1 : (int)xrun->command_unit,
+      (float)((xrun->frame - xrun->command_frame) / rate));
+  }
+  return 0;
+}
+
 void print_usage() {
   printf("Usage: nullunit [options]\n");
   printf("Options:\n");
@@ -145,12 +446,30 @@ void print_usage() {
   printf("  -u, --unit DIR      Directory path to find wasm-units - multiple ok\n");
   printf("  -b, --bundle FILE   File path to load bundle - multiple ok\n");
   printf("  -d, --data FILE     File path to load data (sample) - multiple ok\n");
+  printf("  -t, --threads COUNT Threads to render with, audio thread included (default: 0, one per core it may use)\n");
+  printf("  -r, --render FILE   Render to FILE (.wav, or raw float32) with no audio device, then exit\n");
+  printf("  -s, --seconds N     How many seconds to --render (default: 10)\n");
+  printf("  -e, --engine NAME   How to run units: auto, interp, fast-interp, aot, jit (default: auto)\n");
+  printf("  -z, --ftz           Flush denormals to zero on render threads\n");
+  printf("  -m, --mlock         Lock memory once everything is loaded\n");
+  printf("  -p, --priority N    Run render threads with SCHED_FIFO priority N (1-99)\n");
+  printf("  -c, --cpus LIST     Pin render threads to cores, audio thread first (like 2,3 or 2-5)\n");
+  printf("  -R, --rate HZ       Sample rate (default: 48000, or the nearest the device has)\n");
+  printf("  -B, --block FRAMES  Frames units are run with at a time (default: 256, or less to fit --latency)\n");
+  printf("  -L, --latency MS    Device buffer to ask for, in milliseconds (default: the backend's)\n");
+  printf("  -A, --backend NAME  Audio backend: jack, pulseaudio, alsa, coreaudio, wasapi, dummy (default: first that works)\n");
+  printf("  -D, --device NAME   Output device id, name, or index (default: system default)\n");
 }
 
 int main(int argc, char *argv[]) {
   int in_port = 53100;
   int out_port = 0;
-  NullUnitManager* manager = null_manager_create();
+  int threads = 0;
+  char* renderFile = NULL;
+  double renderSeconds = 10.0;
+  NullUnitEngine engine = NULL_ENGINE_AUTO;
+  NullRealtime realtime = { 0 };
+  NullAudioConfig audio = { 0 };
   cvector_vector_type(char*) unitPaths = NULL;
   cvector_vector_type(char*) bundles = NULL;
   cvector_vector_type(char*) dataFiles = NULL;
@@ -162,12 +481,25 @@ int main(int argc, char *argv[]) {
     { "unit", required_argument, 0, 'u' },
     { "bundle", required_argument, 0, 'b' },
     { "data", required_argument, 0, 'd' },
+    { "threads", required_argument, 0, 't' },
+    { "render", required_argument, 0, 'r' },
+    { "seconds", required_argument, 0, 's' },
+    { "engine", required_argument, 0, 'e' },
+    { "ftz", no_argument, 0, 'z' },
+    { "mlock", no_argument, 0, 'm' },
+    { "priority", required_argument, 0, 'p' },
+    { "cpus", required_argument, 0, 'c' },
+    { "rate", required_argument, 0, 'R' },
+    { "block", required_argument, 0, 'B' },
+    { "latency", required_argument, 0, 'L' },
+    { "backend", required_argument, 0, 'A' },
+    { "device", required_argument, 0, 'D' },
     { 0, 0, 0, 0 }
   };
 
   // Parse command line options
   int opt;
-  while ((opt = getopt_long(argc, argv, "o:i:u:b:d:", long_options, NULL)) != -1) {
+  while ((opt = getopt_long(argc, argv, "o:i:u:b:d:t:r:s:e:zmp:c:R:B:L:A:D:", long_options, NULL)) != -1) {
     switch (opt) {
       case 'o':
         out_port = atoi(optarg);
@@ -184,6 +516,59 @@ int main(int argc, char *argv[]) {
       case 'd':
           cvector_push_back(dataFiles, optarg);
           break;
+      case 't':
+        threads = atoi(optarg);
+        break;
+      case 'r':
+        renderFile = optarg;
+        break;
+      case 's':
+        renderSeconds = atof(optarg);
+        break;
+      case 'e':
+        if (!null_manager_engine_from_name(optarg, &engine)) {
+          fprintf(stderr, "Unknown engine: %s\n", optarg);
+          print_usage();
+          return 1;
+        }
+        break;
+      case 'z':
+        realtime.ftz = true;
+        break;
+      case 'm':
+        realtime.lock_memory = true;
+        break;
+      case 'p':
+        realtime.priority = atoi(optarg);
+        break;
+      case 'c':
+        cvector_free(realtime.cpus);
+        realtime.cpus = NULL;
+        if (!null_realtime_cpus_from_list(optarg, &realtime.cpus)) {
+          fprintf(stderr, "Bad core list: %s\n", optarg);
+          print_usage();
+          return 1;
+        }
+        break;
+      case 'R':
+        audio.sample_rate = atoi(optarg);
+        break;
+      case 'B':
+        audio.block = atoi(optarg);
+        if (audio.block < 1 || audio.block > NULL_MAX_BLOCK) {
+          fprintf(stderr, "Block has to be 1-%d frames\n", NULL_MAX_BLOCK);
+          return 1;
+        }
+        break;
+      case 'L':
+        audio.latency = atof(optarg) / 1000.0;
+        break;
+      case 'A':
+        audio.backend = optarg;
+        break;
+      case 'D':
+        audio.device = optarg;
+        break;
       default:
         print_usage();
         return 1;
@@ -194,12 +579,25 @@ int main(int argc, char *argv[]) {
     out_port = in_port + 1;
   }
 
+  // with --render there is no device, the graph is rendered (as fast as it can) to a file
+  NullUnitManager* manager = renderFile != NULL ? null_manager_create_offline(audio.sample_rate, NULL_MAX_CHANNELS, audio.block) : null_manager_create(&audio);
+  if (manager == NULL) {
+    return 1;
+  }
+  if (!null_manager_set_engine(manager, engine)) {
+    null_manager_destroy(manager);
+    return 1;
+  }
+  null_manager_set_realtime(manager, &realtime);
+  null_manager_set_threads(manager, threads > 0 ? threads : 0);
+
   signal(SIGINT, signal_handler);
 
   // Create OSC server
   char in_port_str[16];
   snprintf(in_port_str, sizeof(in_port_str), "%d", in_port);
-  server = lo_server_new(in_port_str, error_handler);
+  // rendering only needs the server to run bundles through, so it can go on any port
+  server = lo_server_new(renderFile != NULL ? NULL : in_port_str, error_handler);
   if (!server) {
     fprintf(stderr, "Could not create server\n");
     return 1;
@@ -212,6 +610,7 @@ int main(int argc, char *argv[]) {
 
   lo_server_add_method(server, "/unit/load", "s", handle_unit_load, manager);
   lo_server_add_method(server, "/unit/connect", "iiii", handle_unit_connect, manager);
+  lo_server_add_method(server, "/unit/disconnect", "iiii", handle_unit_disconnect, manager);
   lo_server_add_method(server, "/unit/unload", "i", handle_unit_unload, manager);
 
 
@@ -220,6 +619,24 @@ int main(int argc, char *argv[]) {
   lo_server_add_method(server, "/unit/param", "iiff", handle_unit_param_f, manager);
   lo_server_add_method(server, "/unit/param", "iii", handle_unit_param_i_notime, manager);
   lo_server_add_method(server, "/unit/param", "iif", handle_unit_param_f_notime, manager);
+  lo_server_add_method(server, "/unit/param/ramp", "iiff", handle_unit_param_ramp, manager);
+  lo_server_add_method(server, "/unit/param/ramp", "iiffs", handle_unit_param_ramp, manager);
+  lo_server_add_method(server, "/unit/param/ramp", "iiffi", handle_unit_param_ramp, manager);
+  lo_server_add_method(server, "/voices/load", NULL, handle_voices_load, manager);
+  lo_server_add_method(server, "/voices/note", "iif", handle_voices_note, manager);
+  lo_server_add_method(server, "/voices/note", "iii", handle_voices_note, manager);
+  lo_server_add_method(server, "/voices/param", "iiii", handle_voices_param, manager);
+  lo_server_add_method(server, "/voices/param", "iiif", handle_voices_param, manager);
+  lo_server_add_method(server, "/voices/param", "iiiif", handle_voices_param, manager);
+  lo_server_add_method(server, "/voices/param", "iiiff", handle_voices_param, manager);
+  lo_server_add_method(server, "/patch/preload", "s", handle_patch_preload, manager);
+  lo_server_add_method(server, "/patch/switch", "", handle_patch_switch, manager);
+  lo_server_add_method(server, "/patch/switch", "f", handle_patch_switch, manager);
+  lo_server_add_method(server, "/stats", "", handle_stats, manager);
+  lo_server_add_method(server, "/stats/rate", "f", handle_stats_rate, manager);
+  lo_server_add_method(server, "/stats/reset", "", handle_stats_reset, manager);
+  lo_server_add_method(server, "/xruns", "", handle_xruns, manager);
+  lo_server_add_bundle_handlers(server, handle_bundle_start, handle_bundle_end, manager);
 
   int i = 0;
   int c = cvector_size(unitPaths);
@@ -240,35 +657,50 @@ int main(int argc, char *argv[]) {
     }
   }
 
-  // TODO: for each bundle, load file, run messages, and free bytes
-  c = cvector_size(bundles);
+  // audio files are decoded (at engine rate), anything else is raw floats
+  // they are mapped, not read, so pages come off disk as they are played
+  c = cvector_size(dataFiles);
   if (c > 0) {
-    printf("bundles:\n");
+    printf("data:\n");
+    int* sampleIds = calloc(c, sizeof(int));
+    null_manager_load_samples(manager, dataFiles, c, sampleIds);
     for (i=0; i<c; i++) {
-      printf("  %s\n", bundles[i]);
+      if (sampleIds[i] >= 0) {
+        printf("  %d: %s\n", sampleIds[i], dataFiles[i]);
+      } else {
+        printf("  X: %s (not loaded)\n", dataFiles[i]);
+      }
     }
+    free(sampleIds);
   }
 
-  // TODO: currently only supports raw samples, but I could load audio files...
-  c = cvector_size(dataFiles);
+  // bundles are OSC messages (or bundles of them) saved in a file, run like they came in over the network
+  // all of them are one batch, so the whole patch is compiled once, and goes live in one block
+  c = cvector_size(bundles);
   if (c > 0) {
-    printf("data:\n");
-    int bytesLen;
-    int sampleId = 0;
+    printf("bundles:\n");
+    null_manager_batch_begin(manager);
     for (i=0; i<c; i++) {
-      unsigned char* data = null_manager_read_file(dataFiles[i], &bytesLen);
-      if (data != NULL && bytesLen > 0) {
-        printf("  %d: %s\n", sampleId, dataFiles[i]);
-        NullUnitSample sample = {
-          .data = (float*)data,
-          .len = bytesLen
-        };
-        sampleId++;
-        cvector_push_back(manager->samples, sample);
-      } else {
-        printf("  X: %s (not loaded)\n", dataFiles[i]);
+      printf("  %s\n", bundles[i]);
+      int bytesLen;
+      unsigned char* bytes = null_manager_read_file(bundles[i], &bytesLen);
+      if (bytes == NULL || bytesLen <= 0 || lo_server_dispatch_data(server, bytes, bytesLen) < 0) {
+        fprintf(stderr, "Could not run bundle %s\n", bundles[i]);
       }
+      free(bytes);
     }
+    null_manager_batch_end(manager);
+  }
+
+  // everything is loaded, so the audio thread shouldn't page-fault from here on
+  null_manager_lock_memory(manager);
+
+  if (renderFile != NULL) {
+    double factor = null_manager_render_file(manager, renderFile, renderSeconds, 0);
+    lo_address_free(client_address);
+    lo_server_free(server);
+    null_manager_destroy(manager);
+    return factor > 0.0 ? 0 : 1;
   }
 
   printf("nullunit OSC Server running on ports %d/%d\n", in_port, out_port);
@@ -276,8 +708,17 @@ int main(int argc, char *argv[]) {
 
   while (keep_running) {
     lo_server_recv_noblock(server, 100);
-    null_manager_process();
+    if (switch_pending && null_manager_patch_switch(manager, preloaded, switch_fade)) {
+      preloaded = NULL;
+      switch_pending = false;
+    }
+    null_manager_process(manager);
+    if (stats_rate > 0.0 && null_stats_now() - stats_sent >= (uint64_t)(stats_rate * 1e9)) {
+      stats_sent = null_stats_now();
+      send_stats(manager);
+    }
   }
+  null_patch_free(preloaded);
 
   lo_address_free(client_address);
   lo_server_free(server);
@@ -0,0 +1,249 @@
+// on-disk cache of units compiled with wamrc: ~/.cache/nullunits/aot/<sha256>-<target>.aot
+// target is the arch and a hash of the CPU feature set (wamrc compiles for the host CPU), so a binary is
+// never used on a CPU it wasn't made for. missing entries are compiled on a background thread.
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "null_manager.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+#if defined(__linux__) && defined(__aarch64__)
+#include <sys/auxv.h>
+#endif
+
+extern char** environ;
+
+struct NullAotCache {
+  char dir[PATH_MAX];
+  char target[64];
+  const char* wamrc;
+
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  cvector_vector_type(char*) queue; // .wasm paths to compile
+  bool running;
+  pid_t child; // wamrc that is running, so it can be stopped
+  bool busy; // thread has taken a path off the queue, and isn't done with it
+};
+
+#if defined(__x86_64__)
+#define NULL_AOT_ARCH "x86_64"
+#elif defined(__i386__)
+#define NULL_AOT_ARCH "i386"
+#elif defined(__aarch64__)
+#define NULL_AOT_ARCH "aarch64"
+#elif defined(__arm__)
+#define NULL_AOT_ARCH "arm"
+#elif defined(__riscv)
+#define NULL_AOT_ARCH "riscv"
+#else
+#define NULL_AOT_ARCH "unknown"
+#endif
+
+// arch-<hash of CPU features>
+static void aot_target(char* out, size_t size) {
+  uint32_t features[16] = { 0 };
+#if defined(__x86_64__) || defined(__i386__)
+  unsigned int a, b, c, d;
+  if (__get_cpuid(1, &a, &b, &c, &d)) {
+    features[0] = c;
+    features[1] = d;
+    features[8] = a; // model too, wamrc tunes for it
+  }
+  if (__get_cpuid_count(7, 0, &a, &b, &c, &d)) {
+    features[2] = b;
+    features[3] = c;
+    features[4] = d;
+  }
+  if (__get_cpuid_count(7, 1, &a, &b, &c, &d)) {
+    features[5] = a;
+  }
+  if (__get_cpuid(0x80000001, &a, &b, &c, &d)) {
+    features[6] = c;
+    features[7] = d;
+  }
+#elif defined(__linux__) && defined(__aarch64__)
+  features[0] = (uint32_t)getauxval(AT_HWCAP);
+  features[1] = (uint32_t)(getauxval(AT_HWCAP) >> 32);
+  features[2] = (uint32_t)getauxval(AT_HWCAP2);
+  features[3] = (uint32_t)(getauxval(AT_HWCAP2) >> 32);
+#endif
+  uint8_t hash[32];
+  null_sha256((uint8_t*)features, sizeof(features), hash);
+  char hex[65];
+  null_sha256_hex(hash, hex);
+  snprintf(out, size, "%s-%.12s", NULL_AOT_ARCH, hex);
+}
+
+// path of cached .aot for a .wasm (by its content hash), true if it's there
+bool null_aot_cache_path(NullAotCache* cache, const uint8_t hash[32], char* out, size_t size) {
+  if (cache == NULL) {
+    return false;
+  }
+  char hex[65];
+  null_sha256_hex(hash, hex);
+  snprintf(out, size, "%s/%s-%s.aot", cache->dir, hex, cache->target);
+  struct stat st;
+  return stat(out, &st) == 0;
+}
+
+// run wamrc on a .wasm, into the cache (written to a temp file, then renamed, so a half-made one is never loaded)
+static void aot_compile(NullAotCache* cache, const char* wasmPath) {
+  size_t len;
+  unsigned char* bytes = null_manager_map_file(wasmPath, &len, false, NULL);
+  if (bytes == NULL) {
+    return;
+  }
+  uint8_t hash[32];
+  null_sha256(bytes, len, hash);
+  null_manager_unmap_file(bytes, len);
+
+  char aotPath[PATH_MAX];
+  if (null_aot_cache_path(cache, hash, aotPath, sizeof(aotPath))) {
+    return;
+  }
+  char tmpPath[PATH_MAX + 16];
+  snprintf(tmpPath, sizeof(tmpPath), "%s.%d.tmp", aotPath, (int)getpid());
+
+  char* args[] = { (char*)cache->wamrc, "-o", tmpPath, (char*)wasmPath, NULL };
+  posix_spawn_file_actions_t actions;
+  posix_spawn_file_actions_init(&actions);
+  posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+
+  pthread_mutex_lock(&cache->lock);
+  pid_t pid = 0;
+  int err = cache->running ? posix_spawnp(&pid, cache->wamrc, &actions, NULL, args, environ) : ECANCELED;
+  cache->child = err == 0 ? pid : 0;
+  pthread_mutex_unlock(&cache->lock);
+  posix_spawn_file_actions_destroy(&actions);
+
+  if (err != 0) {
+    if (err != ECANCELED) {
+      fprintf(stderr, "Could not run %s (%s), AOT cache is off\n", cache->wamrc, strerror(err));
+      pthread_mutex_lock(&cache->lock);
+      cache->running = false;
+      pthread_mutex_unlock(&cache->lock);
+    }
+    return;
+  }
+
+  int status;
+  while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {}
+  pthread_mutex_lock(&cache->lock);
+  cache->child = 0;
+  pthread_mutex_unlock(&cache->lock);
+
+  if (WIFEXITED(status) && WEXITSTATUS(status) == 0 && rename(tmpPath, aotPath) == 0) {
+    printf("compiled %s to %s\n", wasmPath, aotPath);
+  } else {
+    fprintf(stderr, "Could not compile %s with %s\n", wasmPath, cache->wamrc);
+    unlink(tmpPath);
+  }
+}
+
+static void* aot_thread(void* arg) {
+  NullAotCache* cache = (NullAotCache*)arg;
+  pthread_mutex_lock(&cache->lock);
+  while (cache->running) {
+    if (cvector_size(cache->queue) == 0) {
+      pthread_cond_wait(&cache->wake, &cache->lock);
+      continue;
+    }
+    char* path = cache->queue[0];
+    cvector_erase(cache->queue, 0);
+    cache->busy = true;
+    pthread_mutex_unlock(&cache->lock);
+    aot_compile(cache, path);
+    free(path);
+    pthread_mutex_lock(&cache->lock);
+    cache->busy = false;
+  }
+  pthread_mutex_unlock(&cache->lock);
+  return NULL;
+}
+
+// set up the cache dir, and the thread that fills it, NULL if there is no AOT (or nowhere to put it)
+// $NULLUNITS_AOT_CACHE overrides the dir ("off" to not use a cache), $NULLUNITS_WAMRC the compiler
+NullAotCache* null_aot_cache_create(void) {
+  if (!NULL_WAMR_AOT) {
+    return NULL;
+  }
+
+  char dir[PATH_MAX];
+  if (!null_cache_dir("NULLUNITS_AOT_CACHE", "aot", dir, sizeof(dir))) {
+    return NULL;
+  }
+
+  NullAotCache* cache = calloc(1, sizeof(NullAotCache));
+  snprintf(cache->dir, sizeof(cache->dir), "%s", dir);
+  aot_target(cache->target, sizeof(cache->target));
+  cache->wamrc = getenv("NULLUNITS_WAMRC") != NULL ? getenv("NULLUNITS_WAMRC") : "wamrc";
+  cache->running = true;
+  pthread_mutex_init(&cache->lock, NULL);
+  pthread_cond_init(&cache->wake, NULL);
+  if (pthread_create(&cache->thread, NULL, aot_thread, cache) != 0) {
+    fprintf(stderr, "Could not start AOT compile thread\n");
+    pthread_mutex_destroy(&cache->lock);
+    pthread_cond_destroy(&cache->wake);
+    free(cache);
+    return NULL;
+  }
+  return cache;
+}
+
+// compile a .wasm into the cache in the background (if it's not already there)
+void null_aot_cache_compile(NullAotCache* cache, const char* wasmPath) {
+  if (cache == NULL) {
+    return;
+  }
+  pthread_mutex_lock(&cache->lock);
+  if (cache->running) {
+    cvector_push_back(cache->queue, strdup(wasmPath));
+    pthread_cond_signal(&cache->wake);
+  }
+  pthread_mutex_unlock(&cache->lock);
+}
+
+// true once nothing is queued or compiling (or compiling has stopped)
+bool null_aot_cache_idle(NullAotCache* cache) {
+  if (cache == NULL) {
+    return true;
+  }
+  pthread_mutex_lock(&cache->lock);
+  bool idle = !cache->running || (cvector_size(cache->queue) == 0 && !cache->busy);
+  pthread_mutex_unlock(&cache->lock);
+  return idle;
+}
+
+// stop compiling (anything half-made is thrown away) and free the cache
+void null_aot_cache_free(NullAotCache* cache) {
+  if (cache == NULL) {
+    return;
+  }
+  pthread_mutex_lock(&cache->lock);
+  cache->running = false;
+  if (cache->child > 0) {
+    kill(cache->child, SIGTERM);
+  }
+  pthread_cond_signal(&cache->wake);
+  pthread_mutex_unlock(&cache->lock);
+  pthread_join(cache->thread, NULL);
+
+  for (size_t i = 0; i < cvector_size(cache->queue); i++) {
+    free(cache->queue[i]);
+  }
+  cvector_free(cache->queue);
+  pthread_mutex_destroy(&cache->lock);
+  pthread_cond_destroy(&cache->wake);
+  free(cache);
+}
@@ -0,0 +1,184 @@
+// shared audio bus: every unit's output block gets a page-aligned slot in one shared memory object.
+// a wasm unit has a small view of it in its linear memory: its own slot (which it writes to), and read-only
+// windows that the slots it reads are mapped into, when a plan that needs them is built. a unit with one input can
+// then read it in place, straight from the upstream unit's output, with no copy.
+// slot 0 is never written, so it's silence for units with no input.
+// this needs unit memory that doesn't move when it grows (WAMR's hardware bounds checks reserve it up-front), and
+// if the bus (or a unit's mapping, or a free window) isn't there, units just get their input copied into their own
+// block, like before.
+
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <sys/mman.h>
+#include "null_manager.h"
+
+struct NullBus {
+  int fd;
+  size_t slot_size; // bytes, a block rounded up to a page
+  unsigned int slot_count;
+  uint8_t* base; // host view
+  bool* used; // control thread: which slots are taken
+};
+
+// anonymous shared memory object (also used for the sample bank)
+int null_shared_fd(const char* name, size_t size) {
+  int fd = -1;
+#ifdef __linux__
+  fd = memfd_create(name, MFD_CLOEXEC);
+#else
+  char path[64];
+  snprintf(path, sizeof(path), "/%s-%d", name, (int)getpid());
+  fd = shm_open(path, O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (fd >= 0) {
+    shm_unlink(path);
+  }
+#endif
+  if (fd >= 0 && ftruncate(fd, size) != 0) {
+    close(fd);
+    fd = -1;
+  }
+  return fd;
+}
+
+NullBus* null_bus_create(unsigned int block) {
+#if NULL_WAMR_HW_BOUND_CHECK
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  size_t blockSize = block * NULL_MAX_CHANNELS * sizeof(float);
+
+  NullBus* bus = calloc(1, sizeof(NullBus));
+  bus->slot_size = (blockSize + page - 1) / page * page;
+  bus->slot_count = NULL_BUS_SLOTS;
+  bus->fd = null_shared_fd("nullunits-bus", bus->slot_size * bus->slot_count);
+  if (bus->fd < 0) {
+    fprintf(stderr, "Could not make audio bus, units will copy their input\n");
+    free(bus);
+    return NULL;
+  }
+  bus->base = mmap(NULL, bus->slot_size * bus->slot_count, PROT_READ | PROT_WRITE, MAP_SHARED, bus->fd, 0);
+  if (bus->base == MAP_FAILED) {
+    fprintf(stderr, "Could not map audio bus, units will copy their input\n");
+    close(bus->fd);
+    free(bus);
+    return NULL;
+  }
+  bus->used = calloc(bus->slot_count, sizeof(bool));
+  bus->used[0] = true;
+  return bus;
+#else
+  // without hardware bounds checks, WAMR moves unit memory when it grows, so there is nothing stable to map into
+  return NULL;
+#endif
+}
+
+void null_bus_free(NullBus* bus) {
+  if (bus == NULL) {
+    return;
+  }
+  munmap(bus->base, bus->slot_size * bus->slot_count);
+  close(bus->fd);
+  free(bus->used);
+  free(bus);
+}
+
+// give a unit a slot for its output (0 if bus is full, or not there)
+int null_bus_slot_alloc(NullBus* bus) {
+  if (bus == NULL) {
+    return 0;
+  }
+  for (unsigned int i = 1; i < bus->slot_count; i++) {
+    if (!bus->used[i]) {
+      bus->used[i] = true;
+      memset(null_bus_slot(bus, i), 0, bus->slot_size);
+      return (int)i;
+    }
+  }
+  return 0;
+}
+
+void null_bus_slot_free(NullBus* bus, int slot) {
+  if (bus != NULL && slot > 0) {
+    bus->used[slot] = false;
+  }
+}
+
+// host pointer to a slot
+float* null_bus_slot(NullBus* bus, int slot) {
+  return (float*)(bus->base + (bus->slot_size * slot));
+}
+
+// app-offset of a window of a unit's view of the bus (0 is its own slot)
+uint32_t null_bus_window_app(NullBus* bus, NullUnit* unit, int window) {
+  return unit->bus_view + (uint32_t)(bus->slot_size * window);
+}
+
+// put plain memory back where a window was, so the unit doesn't trip over a hole in its heap
+static void bus_window_clear(NullBus* bus, uint8_t* window) {
+  mmap(window, bus->slot_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+}
+
+// map a unit's own slot into its memory, with room for windows onto what it reads, false if it can't be
+// (then it reads and writes its own blocks)
+bool null_bus_map_unit(NullBus* bus, NullUnit* unit) {
+  if (bus == NULL || unit->bus_slot == 0) {
+    return false;
+  }
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  uint32_t region = wasm_runtime_module_malloc(unit->module_inst, (bus->slot_size * NULL_BUS_WINDOWS) + page, NULL);
+  if (region == 0) {
+    return false;
+  }
+  uint8_t* native = wasm_runtime_addr_app_to_native(unit->module_inst, region);
+  uint8_t* aligned = (uint8_t*)(((uintptr_t)native + page - 1) & ~(uintptr_t)(page - 1));
+
+  if (mmap(aligned, bus->slot_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, bus->fd, bus->slot_size * unit->bus_slot) == MAP_FAILED) {
+    bus_window_clear(bus, aligned);
+    wasm_runtime_module_free(unit->module_inst, region);
+    return false;
+  }
+  unit->bus_view = region + (uint32_t)(aligned - native);
+  unit->bus_native = aligned;
+  unit->bus_windows[0] = unit->bus_slot;
+  unit->bus_window_refs[0] = 0;
+  for (int w = 1; w < NULL_BUS_WINDOWS; w++) {
+    unit->bus_windows[w] = -1;
+    unit->bus_window_refs[w] = 0;
+  }
+  return true;
+}
+
+// window of a unit's view that a slot is mapped into (mapping it into one no plan uses, if it isn't), for a plan
+// that reads it in place, -1 if there is no room (then the plan copies it), release it when the plan is freed
+int null_bus_window(NullBus* bus, NullUnit* unit, int slot) {
+  if (bus == NULL || unit->bus_view == 0) {
+    return -1;
+  }
+  int spare = -1;
+  for (int w = 0; w < NULL_BUS_WINDOWS; w++) {
+    if (unit->bus_windows[w] == slot) {
+      unit->bus_window_refs[w]++;
+      return w;
+    }
+    if (w > 0 && spare < 0 && unit->bus_window_refs[w] == 0) {
+      spare = w;
+    }
+  }
+  if (spare < 0) {
+    return -1;
+  }
+  uint8_t* window = unit->bus_native + (bus->slot_size * spare);
+  if (mmap(window, bus->slot_size, PROT_READ, MAP_SHARED | MAP_FIXED, bus->fd, bus->slot_size * slot) == MAP_FAILED) {
+    bus_window_clear(bus, window);
+    unit->bus_windows[spare] = -1;
+    return -1;
+  }
+  unit->bus_windows[spare] = slot;
+  unit->bus_window_refs[spare] = 1;
+  return spare;
+}
+
+// a plan that read from a window is done with it
+void null_bus_window_release(NullUnit* unit, int window) {
+  if (window >= 0 && unit->bus_window_refs[window] > 0) {
+    unit->bus_window_refs[window]--;
+  }
+}
@@ -0,0 +1,450 @@
+// decoding sample files (WAV, AIFF/AIFC, and FLAC if it's built) into floats at the engine's rate
+// files are decoded in parallel, and (unless $NULLUNITS_SAMPLE_CACHE is "off") what they decode to is kept in
+// ~/.cache/nullunits/samples, as raw floats, so next time they are just mapped (and streamed, if they're big)
+// anything that isn't one of these is a raw float file, like before
+
+#define _GNU_SOURCE
+#include <limits.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "null_manager.h"
+
+#if NULL_FLAC
+#define DR_FLAC_IMPLEMENTATION
+#define DR_FLAC_NO_STDIO
+#include "dr_flac.h"
+#endif
+
+// half the taps of the resampling filter (at full bandwidth)
+#define NULL_RESAMPLE_TAPS 16
+
+// most channels a sample file can have
+#define NULL_DECODE_MAX_CHANNELS 8
+
+// a file being loaded
+typedef struct {
+  const char* filename;
+  float* data; // decoded (NULL if it's raw, or cached)
+  size_t frames;
+  unsigned int channels;
+  char cached[PATH_MAX]; // decoded already, in the cache ("" if not)
+  bool failed;
+} NullDecodeJob;
+
+typedef struct {
+  NullDecodeJob* jobs;
+  size_t count;
+  atomic_size_t next;
+  unsigned int sample_rate;
+  const char* cache_dir; // NULL if there is no cache
+} NullDecodeQueue;
+
+static uint16_t le16(const uint8_t* p) {
+  return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t le32(const uint8_t* p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint16_t be16(const uint8_t* p) {
+  return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static uint32_t be32(const uint8_t* p) {
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+// 80-bit IEEE extended (AIFF sample rate)
+static double be_extended(const uint8_t* p) {
+  int exponent = ((p[0] & 0x7f) << 8) | p[1];
+  uint64_t mantissa = 0;
+  for (int i = 0; i < 8; i++) {
+    mantissa = (mantissa << 8) | p[2 + i];
+  }
+  if (exponent == 0 && mantissa == 0) {
+    return 0.0;
+  }
+  double value = ldexp((double)mantissa, exponent - 16383 - 63);
+  return (p[0] & 0x80) ? -value : value;
+}
+
+typedef enum {
+  NULL_PCM_INT,
+  NULL_PCM_UINT8, // WAV 8-bit is unsigned
+  NULL_PCM_FLOAT
+} NullPcmKind;
+
+// PCM (frames * channels values, bits each, in either byte-order) to floats
+static float* pcm_to_float(const uint8_t* in, size_t count, unsigned int bits, NullPcmKind kind, bool bigEndian) {
+  unsigned int bytes = bits / 8;
+  float* out = malloc((count > 0 ? count : 1) * sizeof(float));
+  for (size_t i = 0; i < count; i++) {
+    uint8_t s[8];
+    for (unsigned int b = 0; b < bytes; b++) {
+      s[b] = bigEndian ? in[(i * bytes) + (bytes - 1 - b)] : in[(i * bytes) + b];
+    }
+    if (kind == NULL_PCM_FLOAT && bytes == 4) {
+      uint32_t v = le32(s);
+      float f;
+      memcpy(&f, &v, 4);
+      out[i] = f;
+    } else if (kind == NULL_PCM_FLOAT) {
+      uint64_t v = (uint64_t)le32(s) | ((uint64_t)le32(s + 4) << 32);
+      double d;
+      memcpy(&d, &v, 8);
+      out[i] = (float)d;
+    } else if (kind == NULL_PCM_UINT8) {
+      out[i] = ((float)s[0] - 128.0f) / 128.0f;
+    } else {
+      uint64_t u = 0;
+      for (int b = (int)bytes - 1; b >= 0; b--) {
+        u = (u << 8) | s[b];
+      }
+      double half = (double)(1ULL << (bits - 1));
+      double v = u >= (1ULL << (bits - 1)) ? (double)u - (2.0 * half) : (double)u; // two's complement
+      out[i] = (float)(v / half);
+    }
+  }
+  return out;
+}
+
+static bool pcm_ok(unsigned int bits, NullPcmKind kind, unsigned int channels) {
+  if (channels == 0 || channels > NULL_DECODE_MAX_CHANNELS) {
+    return false;
+  }
+  if (kind == NULL_PCM_FLOAT) {
+    return bits == 32 || bits == 64;
+  }
+  return bits == 8 || bits == 16 || bits == 24 || bits == 32;
+}
+
+// RIFF/WAVE: PCM (8-32 bit), or float (32/64 bit)
+static float* decode_wav(const uint8_t* data, size_t size, unsigned int* channels, double* rate, size_t* frames) {
+  unsigned int format = 0, bits = 0;
+  const uint8_t* pcm = NULL;
+  size_t pcmSize = 0;
+  *channels = 0;
+  for (size_t pos = 12; pos + 8 <= size;) {
+    uint32_t chunkSize = le32(data + pos + 4);
+    const uint8_t* chunk = data + pos + 8;
+    size_t available = size - pos - 8;
+    if (memcmp(data + pos, "fmt ", 4) == 0 && chunkSize >= 16 && available >= 16) {
+      format = le16(chunk);
+      *channels = le16(chunk + 2);
+      *rate = le32(chunk + 4);
+      bits = le16(chunk + 14);
+      if (format == 0xfffe && chunkSize >= 26 && available >= 26) {
+        format = le16(chunk + 24); // WAVE_FORMAT_EXTENSIBLE: sub-format GUID starts with the format
+      }
+    } else if (memcmp(data + pos, "data", 4) == 0) {
+      pcm = chunk;
+      pcmSize = chunkSize < available ? chunkSize : available;
+    }
+    pos += 8 + (size_t)chunkSize + (chunkSize & 1);
+  }
+  NullPcmKind kind = format == 3 ? NULL_PCM_FLOAT : (bits == 8 ? NULL_PCM_UINT8 : NULL_PCM_INT);
+  if (pcm == NULL || (format != 1 && format != 3) || !pcm_ok(bits, kind, *channels)) {
+    return NULL;
+  }
+  *frames = pcmSize / ((bits / 8) * *channels);
+  return pcm_to_float(pcm, *frames * *channels, bits, kind, false);
+}
+
+// FORM/AIFF (big-endian PCM), or AIFC (NONE, sowt, fl32, fl64)
+static float* decode_aiff(const uint8_t* data, size_t size, unsigned int* channels, double* rate, size_t* frames) {
+  bool aifc = memcmp(data + 8, "AIFC", 4) == 0;
+  unsigned int bits = 0;
+  NullPcmKind kind = NULL_PCM_INT;
+  bool bigEndian = true;
+  const uint8_t* pcm = NULL;
+  size_t pcmSize = 0;
+  *channels = 0;
+  for (size_t pos = 12; pos + 8 <= size;) {
+    uint32_t chunkSize = be32(data + pos + 4);
+    const uint8_t* chunk = data + pos + 8;
+    size_t available = size - pos - 8;
+    if (memcmp(data + pos, "COMM", 4) == 0 && chunkSize >= 18 && available >= 18) {
+      *channels = be16(chunk);
+      bits = be16(chunk + 6);
+      *rate = be_extended(chunk + 8);
+      if (aifc && chunkSize >= 22 && available >= 22) {
+        const uint8_t* compression = chunk + 18;
+        if (memcmp(compression, "sowt", 4) == 0) {
+          bigEndian = false;
+        } else if (memcmp(compression, "fl32", 4) == 0 || memcmp(compression, "FL32", 4) == 0) {
+          kind = NULL_PCM_FLOAT;
+          bits = 32;
+        } else if (memcmp(compression, "fl64", 4) == 0 || memcmp(compression, "FL64", 4) == 0) {
+          kind = NULL_PCM_FLOAT;
+          bits = 64;
+        } else if (memcmp(compression, "NONE", 4) != 0) {
+          return NULL;
+        }
+      }
+    } else if (memcmp(data + pos, "SSND", 4) == 0 && chunkSize >= 8 && available >= 8) {
+      uint32_t offset = be32(chunk);
+      if ((size_t)offset + 8 <= available && offset + 8 <= chunkSize) {
+        pcm = chunk + 8 + offset;
+        pcmSize = (chunkSize < available ? chunkSize : available) - 8 - offset;
+      }
+    }
+    pos += 8 + (size_t)chunkSize + (chunkSize & 1);
+  }
+  if (kind == NULL_PCM_INT) {
+    bits = (bits + 7) / 8 * 8; // odd sizes (like 12-bit) are stored left-justified in whole bytes
+  }
+  if (pcm == NULL || !pcm_ok(bits, kind, *channels)) {
+    return NULL;
+  }
+  *frames = pcmSize / ((bits / 8) * *channels);
+  return pcm_to_float(pcm, *frames * *channels, bits, kind, bigEndian);
+}
+
+#if NULL_FLAC
+static float* decode_flac(const uint8_t* data, size_t size, unsigned int* channels, double* rate, size_t* frames) {
+  unsigned int flacChannels, flacRate;
+  drflac_uint64 flacFrames;
+  float* flac = drflac_open_memory_and_read_pcm_frames_f32(data, size, &flacChannels, &flacRate, &flacFrames, NULL);
+  if (flac == NULL || flacChannels == 0 || flacChannels > NULL_DECODE_MAX_CHANNELS) {
+    drflac_free(flac, NULL);
+    return NULL;
+  }
+  // so it's freed like the others
+  float* out = malloc((flacFrames > 0 ? flacFrames * flacChannels : 1) * sizeof(float));
+  memcpy(out, flac, flacFrames * flacChannels * sizeof(float));
+  drflac_free(flac, NULL);
+  *channels = flacChannels;
+  *rate = flacRate;
+  *frames = flacFrames;
+  return out;
+}
+#endif
+
+// is this a file we decode (not raw floats)?
+static bool is_audio_file(const uint8_t* data, size_t size) {
+  if (size >= 12 && memcmp(data, "RIFF", 4) == 0 && memcmp(data + 8, "WAVE", 4) == 0) {
+    return true;
+  }
+  if (size >= 12 && memcmp(data, "FORM", 4) == 0 && (memcmp(data + 8, "AIFF", 4) == 0 || memcmp(data + 8, "AIFC", 4) == 0)) {
+    return true;
+  }
+  return size >= 4 && memcmp(data, "fLaC", 4) == 0;
+}
+
+static float* decode(const uint8_t* data, size_t size, unsigned int* channels, double* rate, size_t* frames) {
+  if (memcmp(data, "RIFF", 4) == 0) {
+    return decode_wav(data, size, channels, rate, frames);
+  }
+  if (memcmp(data, "FORM", 4) == 0) {
+    return decode_aiff(data, size, channels, rate, frames);
+  }
+#if NULL_FLAC
+  return decode_flac(data, size, channels, rate, frames);
+#else
+  return NULL;
+#endif
+}
+
+static double sinc(double x) {
+  return x == 0.0 ? 1.0 : sin(M_PI * x) / (M_PI * x);
+}
+
+// windowed-sinc resample of interleaved frames (band-limited to the lower of the two rates)
+static float* resample(const float* in, size_t frames, unsigned int channels, double from, double to, size_t* outFrames) {
+  double step = from / to;
+  double cutoff = to < from ? to / from : 1.0;
+  int half = (int)ceil(NULL_RESAMPLE_TAPS / cutoff);
+  *outFrames = (size_t)ceil((double)frames / step);
+  float* out = malloc((*outFrames > 0 ? *outFrames * channels : 1) * sizeof(float));
+  double* weights = malloc(2 * half * sizeof(double));
+
+  for (size_t i = 0; i < *outFrames; i++) {
+    double pos = (double)i * step;
+    int64_t center = (int64_t)floor(pos);
+    double frac = pos - (double)center;
+    double total = 0.0;
+    for (int k = 0; k < 2 * half; k++) {
+      double x = (double)(k - half + 1) - frac;
+      double window = 0.42 + (0.5 * cos(M_PI * x / half)) + (0.08 * cos(2.0 * M_PI * x / half)); // Blackman
+      weights[k] = fabs(x) < half ? cutoff * sinc(cutoff * x) * window : 0.0;
+      total += weights[k];
+    }
+    for (unsigned int c = 0; c < channels; c++) {
+      double sum = 0.0;
+      for (int k = 0; k < 2 * half; k++) {
+        int64_t index = center + k - half + 1;
+        if (index >= 0 && index < (int64_t)frames) {
+          sum += weights[k] * in[(index * channels) + c];
+        }
+      }
+      out[(i * channels) + c] = (float)(total != 0.0 ? sum / total : sum);
+    }
+  }
+  free(weights);
+  return out;
+}
+
+// cache entry for a file: by its path, size and mtime (so it's not hashed), and the rate it's decoded to
+static void cache_path(const char* dir, const char* filename, const struct stat* st, unsigned int sampleRate, unsigned int channels, char* out, size_t size) {
+  char key[PATH_MAX + 64];
+  char real[PATH_MAX];
+  if (realpath(filename, real) == NULL) {
+    snprintf(real, sizeof(real), "%s", filename);
+  }
+#ifdef __APPLE__
+  struct timespec mtime = st->st_mtimespec;
+#else
+  struct timespec mtime = st->st_mtim;
+#endif
+  int len = snprintf(key, sizeof(key), "%s:%lld:%lld.%09ld", real, (long long)st->st_size, (long long)mtime.tv_sec, (long)mtime.tv_nsec);
+  uint8_t hash[32];
+  null_sha256((uint8_t*)key, len, hash);
+  char hex[65];
+  null_sha256_hex(hash, hex);
+  snprintf(out, size, "%s/%.32s-%u-%uch.raw", dir, hex, sampleRate, channels);
+}
+
+// write decoded floats to the cache (temp file, then rename, so a half-written one is never used)
+// it's float32, not 16-bit: the cached file is what units get mapped (get_data_ptr hands out floats in place), and
+// 24-bit and float sources would lose resolution
+static bool cache_write(const char* path, const float* data, size_t count) {
+  char tmpPath[PATH_MAX + 32];
+  snprintf(tmpPath, sizeof(tmpPath), "%s.%d.%lu.tmp", path, (int)getpid(), (unsigned long)pthread_self());
+  FILE* file = fopen(tmpPath, "wb");
+  if (file == NULL) {
+    return false;
+  }
+  bool ok = fwrite(data, sizeof(float), count, file) == count;
+  ok = fclose(file) == 0 && ok;
+  if (!ok || rename(tmpPath, path) != 0) {
+    unlink(tmpPath);
+    return false;
+  }
+  return true;
+}
+
+// decode a file (or find it in the cache), leave raw files alone
+static void decode_job(NullDecodeQueue* queue, NullDecodeJob* job) {
+  size_t size;
+  uint8_t* data = null_manager_map_file(job->filename, &size, false, NULL);
+  if (data == NULL || !is_audio_file(data, size)) {
+    null_manager_unmap_file(data, size);
+    return;
+  }
+
+  struct stat st;
+  bool cacheable = queue->cache_dir != NULL && stat(job->filename, &st) == 0;
+  if (cacheable) {
+    for (unsigned int channels = 1; channels <= NULL_DECODE_MAX_CHANNELS; channels++) {
+      char path[PATH_MAX];
+      cache_path(queue->cache_dir, job->filename, &st, queue->sample_rate, channels, path, sizeof(path));
+      if (access(path, R_OK) == 0) {
+        snprintf(job->cached, sizeof(job->cached), "%s", path);
+        job->channels = channels;
+        null_manager_unmap_file(data, size);
+        return;
+      }
+    }
+  }
+
+  double rate = 0.0;
+  float* decoded = decode(data, size, &job->channels, &rate, &job->frames);
+  null_manager_unmap_file(data, size);
+  if (decoded == NULL || job->frames == 0 || rate <= 0.0) {
+    fprintf(stderr, "Could not decode %s\n", job->filename);
+    free(decoded);
+    job->failed = true;
+    return;
+  }
+
+  // once, here, so nothing has to resample while it plays
+  if (fabs(rate - queue->sample_rate) > 0.5) {
+    size_t frames;
+    float* resampled = resample(decoded, job->frames, job->channels, rate, queue->sample_rate, &frames);
+    free(decoded);
+    decoded = resampled;
+    job->frames = frames;
+  }
+  if (job->frames * job->channels * sizeof(float) > INT32_MAX) {
+    fprintf(stderr, "%s is too big for a sample\n", job->filename);
+    free(decoded);
+    job->failed = true;
+    return;
+  }
+
+  if (cacheable) {
+    char path[PATH_MAX];
+    cache_path(queue->cache_dir, job->filename, &st, queue->sample_rate, job->channels, path, sizeof(path));
+    if (cache_write(path, decoded, job->frames * job->channels)) {
+      snprintf(job->cached, sizeof(job->cached), "%s", path);
+      free(decoded);
+      return;
+    }
+  }
+  job->data = decoded;
+}
+
+static void* decode_thread(void* arg) {
+  NullDecodeQueue* queue = (NullDecodeQueue*)arg;
+  size_t i;
+  while ((i = atomic_fetch_add(&queue->next, 1)) < queue->count) {
+    decode_job(queue, &queue->jobs[i]);
+  }
+  return NULL;
+}
+
+// load sample files (decoding them, in parallel), ids gets each one's sample id (-1 if it didn't load)
+void null_manager_load_samples(NullUnitManager* manager, char** filenames, size_t count, int* ids) {
+  if (count == 0) {
+    return;
+  }
+  NullDecodeQueue queue = { .count=count, .sample_rate=manager->sample_rate };
+  queue.jobs = calloc(count, sizeof(NullDecodeJob));
+  for (size_t i = 0; i < count; i++) {
+    queue.jobs[i].filename = filenames[i];
+  }
+  char cacheDir[PATH_MAX];
+  if (null_cache_dir("NULLUNITS_SAMPLE_CACHE", "samples", cacheDir, sizeof(cacheDir))) {
+    queue.cache_dir = cacheDir;
+  }
+
+  long cores = sysconf(_SC_NPROCESSORS_ONLN);
+  size_t threadCount = cores > 1 ? (size_t)cores : 1;
+  if (threadCount > count) {
+    threadCount = count;
+  }
+  pthread_t* threads = calloc(threadCount, sizeof(pthread_t));
+  size_t started = 0;
+  for (size_t i = 1; i < threadCount; i++) {
+    if (pthread_create(&threads[i], NULL, decode_thread, &queue) == 0) {
+      started = i;
+    } else {
+      break;
+    }
+  }
+  decode_thread(&queue);
+  for (size_t i = 1; i <= started; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  free(threads);
+
+  // added in order, so ids follow the order they were given in
+  for (size_t i = 0; i < count; i++) {
+    NullDecodeJob* job = &queue.jobs[i];
+    if (job->data != NULL) {
+      ids[i] = null_manager_add_sample(manager, job->data, (int)(job->frames * job->channels * sizeof(float)));
+      free(job->data);
+    } else if (job->cached[0] != '\0') {
+      ids[i] = null_manager_load_sample(manager, job->cached);
+    } else if (!job->failed) {
+      ids[i] = null_manager_load_sample(manager, job->filename);
+    } else {
+      ids[i] = -1;
+    }
+    if (ids[i] >= 0 && job->channels > 0) {
+      manager->samples[ids[i]].channels = job->channels;
+    }
+  }
+  free(queue.jobs);
+}
@@ -0,0 +1,859 @@
+// this compiles connections into a flat plan, and renders it on the audio thread
+
+#include "null_manager.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+// free a plan
+void null_plan_free(NullUnitPlan* plan) {
+  if (plan == NULL) {
+    return;
+  }
+  for (unsigned int n = 0; n < plan->node_count; n++) {
+    null_bus_window_release(plan->nodes[n].unit, plan->nodes[n].window);
+  }
+  free(plan->nodes);
+  free(plan->outputs);
+  free(plan->inputs);
+  free(plan->dependents);
+  free(plan);
+}
+
+// compile connections into a new plan, and hand it to the audio thread
+void null_manager_compile(NullUnitManager* manager) {
+  // a batch compiles once, when it ends
+  if (manager->batch_depth > 0) {
+    manager->batch_compile = true;
+    return;
+  }
+
+  NullUnitPlan* plan = null_plan_compile(manager);
+  NullCommand command = {
+    .type = NULL_COMMAND_PLAN,
+    .plan = plan,
+    .serial = plan->serial
+  };
+  if (!null_manager_send(manager, &command)) {
+    null_plan_free(plan);
+  }
+}
+
+// compile connections into a new plan
+NullUnitPlan* null_plan_compile(NullUnitManager* manager) {
+  NullUnitPlan* plan = null_plan_build(manager->units, cvector_size(manager->units), manager->connections, cvector_size(manager->connections));
+  plan->serial = ++manager->plan_serial_next;
+  return plan;
+}
+
+// compile connections between units (by id) into a plan, with no serial yet
+NullUnitPlan* null_plan_build(NullUnit** units, unsigned int unitCount, NullUnitConnection* connections, unsigned int connectionCount) {
+
+  // only units that (eventually) feed audioOut need to run
+  bool* needed = calloc(unitCount, sizeof(bool));
+  bool changed = true;
+  for (unsigned int i = 0; i < connectionCount; i++) {
+    if (connections[i].destination == 0) {
+      needed[connections[i].source] = true;
+    }
+  }
+  while (changed) {
+    changed = false;
+    for (unsigned int i = 0; i < connectionCount; i++) {
+      NullUnitConnection* c = &connections[i];
+      if (c->destination != 0 && needed[c->destination] && !needed[c->source]) {
+        needed[c->source] = true;
+        changed = true;
+      }
+    }
+  }
+
+  // count inputs of needed units (Kahn's algorithm)
+  unsigned int* pending = calloc(unitCount, sizeof(unsigned int));
+  unsigned int inputCount = 0;
+  unsigned int outputCount = 0;
+  for (unsigned int i = 0; i < connectionCount; i++) {
+    NullUnitConnection* c = &connections[i];
+    if (c->destination == 0) {
+      outputCount++;
+    } else if (needed[c->destination]) {
+      pending[c->destination]++;
+      inputCount++;
+    }
+  }
+
+  NullUnitPlan* plan = calloc(1, sizeof(NullUnitPlan));
+  plan->nodes = calloc(unitCount, sizeof(NullUnitPlanNode));
+  plan->outputs = calloc(outputCount ? outputCount : 1, sizeof(NullUnit*));
+  plan->inputs = calloc(inputCount ? inputCount : 1, sizeof(NullUnit*));
+
+  bool* placed = calloc(unitCount, sizeof(bool));
+  unsigned int* order = calloc(unitCount, sizeof(unsigned int));
+  unsigned int orderCount = 0;
+  unsigned int head = 0;
+  for (unsigned int id = 1; id < unitCount; id++) {
+    if (needed[id] && pending[id] == 0) {
+      order[orderCount++] = id;
+      placed[id] = true;
+    }
+  }
+  while (true) {
+    while (head < orderCount) {
+      unsigned int id = order[head++];
+      for (unsigned int i = 0; i < connectionCount; i++) {
+        NullUnitConnection* c = &connections[i];
+        if (c->source == id && c->destination != 0 && needed[c->destination] && !placed[c->destination] && --pending[c->destination] == 0) {
+          order[orderCount++] = c->destination;
+          placed[c->destination] = true;
+        }
+      }
+    }
+
+    // whatever is left is in a feedback loop: break it at the lowest id, those inputs are a block late
+    unsigned int id = 1;
+    while (id < unitCount && (!needed[id] || placed[id])) {
+      id++;
+    }
+    if (id >= unitCount) {
+      break;
+    }
+    order[orderCount++] = id;
+    placed[id] = true;
+  }
+
+  // flatten into nodes, with their inputs next to each other
+  unsigned int* nodeIndex = calloc(unitCount, sizeof(unsigned int));
+  unsigned int inputIndex = 0;
+  for (unsigned int n = 0; n < orderCount; n++) {
+    NullUnitPlanNode* node = &plan->nodes[plan->node_count++];
+    node->unit = units[order[n]];
+    node->inputs = &plan->inputs[inputIndex];
+    nodeIndex[order[n]] = n;
+    for (unsigned int i = 0; i < connectionCount; i++) {
+      if (connections[i].destination == order[n]) {
+        plan->inputs[inputIndex++] = units[connections[i].source];
+        node->input_count++;
+      }
+    }
+
+    // one input (or none) from the bus: map its slot into the unit's view, to read it in place
+    node->window = -1;
+    NullUnit* unit = node->unit;
+    if (unit->kind == NULL_UNIT_WASM && unit->bus_view != 0 && node->input_count <= 1 && (node->input_count == 0 || null_unit_bus_out(node->inputs[0]))) {
+      node->window = null_bus_window(unit->manager->bus, unit, node->input_count == 0 ? 0 : node->inputs[0]->bus_slot);
+    }
+  }
+
+  // dependencies, so workers can run nodes as soon as their inputs are ready
+  // a node waits on the nodes it reads from, and a feedback source waits for its (earlier) reader,
+  // so the reader still gets last block's output
+  unsigned int* edgeFrom = calloc(inputIndex ? inputIndex : 1, sizeof(unsigned int));
+  unsigned int* edgeTo = calloc(inputIndex ? inputIndex : 1, sizeof(unsigned int));
+  unsigned int edgeCount = 0;
+  for (unsigned int i = 0; i < connectionCount; i++) {
+    NullUnitConnection* c = &connections[i];
+    if (c->destination == 0 || !needed[c->destination]) {
+      continue;
+    }
+    if (c->source == c->destination) {
+      plan->feedback = true;
+      continue;
+    }
+    unsigned int from = nodeIndex[c->source];
+    unsigned int to = nodeIndex[c->destination];
+    if (from > to) {
+      plan->feedback = true;
+      unsigned int t = from;
+      from = to;
+      to = t;
+    }
+    bool seen = false;
+    for (unsigned int e = 0; e < edgeCount && !seen; e++) {
+      seen = edgeFrom[e] == from && edgeTo[e] == to;
+    }
+    if (!seen) {
+      edgeFrom[edgeCount] = from;
+      edgeTo[edgeCount] = to;
+      edgeCount++;
+      plan->nodes[from].dependent_count++;
+      plan->nodes[to].dependency_count++;
+    }
+  }
+  plan->dependents = calloc(edgeCount ? edgeCount : 1, sizeof(unsigned int));
+  unsigned int dependentIndex = 0;
+  for (unsigned int n = 0; n < plan->node_count; n++) {
+    NullUnitPlanNode* node = &plan->nodes[n];
+    node->dependents = &plan->dependents[dependentIndex];
+    dependentIndex += node->dependent_count;
+    node->dependent_count = 0;
+  }
+  for (unsigned int e = 0; e < edgeCount; e++) {
+    NullUnitPlanNode* node = &plan->nodes[edgeFrom[e]];
+    node->dependents[node->dependent_count++] = edgeTo[e];
+  }
+  for (unsigned int i = 0; i < connectionCount; i++) {
+    if (connections[i].destination == 0) {
+      plan->outputs[plan->output_count++] = units[connections[i].source];
+    }
+  }
+
+  free(needed);
+  free(pending);
+  free(placed);
+  free(order);
+  free(nodeIndex);
+  free(edgeFrom);
+  free(edgeTo);
+  return plan;
+}
+
+// audio thread: units can render on any worker, so they keep what they are done with until the block is finished
+static void release_event(NullUnit* unit, NullUnitEvent* event) {
+  event->next = unit->spent_events;
+  unit->spent_events = event;
+}
+
+static void release_ramp(NullUnit* unit, NullUnitRamp* ramp) {
+  ramp->next = unit->spent_ramps;
+  unit->spent_ramps = ramp;
+}
+
+// audio thread: give a unit's spent events and ramps back to the pools (only between blocks)
+static void reclaim(NullUnitManager* manager, NullUnit* unit) {
+  while (unit->spent_events != NULL) {
+    NullUnitEvent* event = unit->spent_events;
+    unit->spent_events = event->next;
+    event->next = manager->event_free;
+    manager->event_free = event;
+  }
+  while (unit->spent_ramps != NULL) {
+    NullUnitRamp* ramp = unit->spent_ramps;
+    unit->spent_ramps = ramp->next;
+    ramp->next = manager->ramp_free;
+    manager->ramp_free = ramp;
+  }
+}
+
+// control thread: put an event on the list audio thread takes back into the pool (any number of threads can push,
+// and audio thread only ever takes the whole list, so there's no ABA)
+static void return_event(NullUnitManager* manager, NullUnitEvent* event) {
+  NullUnitEvent* head = atomic_load_explicit(&manager->event_returned, memory_order_relaxed);
+  do {
+    event->next = head;
+  } while (!atomic_compare_exchange_weak_explicit(&manager->event_returned, &head, event, memory_order_release, memory_order_relaxed));
+}
+
+static void return_ramp(NullUnitManager* manager, NullUnitRamp* ramp) {
+  NullUnitRamp* head = atomic_load_explicit(&manager->ramp_returned, memory_order_relaxed);
+  do {
+    ramp->next = head;
+  } while (!atomic_compare_exchange_weak_explicit(&manager->ramp_returned, &head, ramp, memory_order_release, memory_order_relaxed));
+}
+
+// control thread: give the events and ramps a unit still has back to the pools (once audio thread is done with it),
+// so unloading it doesn't need a command
+void null_unit_return_events(NullUnitManager* manager, NullUnit* unit) {
+  NullUnitEvent* lists[2] = { unit->events, unit->spent_events };
+  for (int l = 0; l < 2; l++) {
+    while (lists[l] != NULL) {
+      NullUnitEvent* event = lists[l];
+      lists[l] = event->next;
+      return_event(manager, event);
+    }
+  }
+  NullUnitRamp* ramps[2] = { unit->ramps, unit->spent_ramps };
+  for (int l = 0; l < 2; l++) {
+    while (ramps[l] != NULL) {
+      NullUnitRamp* ramp = ramps[l];
+      ramps[l] = ramp->next;
+      return_ramp(manager, ramp);
+    }
+  }
+  unit->events = NULL;
+  unit->spent_events = NULL;
+  unit->ramps = NULL;
+  unit->spent_ramps = NULL;
+}
+
+// audio thread: stop a param from ramping
+static void cancel_ramp(NullUnit* unit, unsigned int paramId) {
+  NullUnitRamp** link = &unit->ramps;
+  while (*link != NULL) {
+    NullUnitRamp* ramp = *link;
+    if (ramp->param == paramId) {
+      *link = ramp->next;
+      release_ramp(unit, ramp);
+    } else {
+      link = &ramp->next;
+    }
+  }
+}
+
+// audio thread: a param was set directly, so it stops ramping (and a sleeping unit wakes)
+static void set_param_now(NullUnit* unit, unsigned int paramId, NullUnitParamValue value) {
+  if (unit->ramps != NULL) {
+    cancel_ramp(unit, paramId);
+  }
+  unit->asleep = false;
+  null_unit_set_param(unit, paramId, value);
+}
+
+// audio thread: start ramping a param from where it is now
+static void start_ramp(NullUnitManager* manager, NullUnit* unit, NullCommand* command, uint64_t frame) {
+  if (command->param >= unit->param_count) {
+    return;
+  }
+  unit->asleep = false;
+  NullUnitParamType type = unit->info->params[command->param]->type;
+  NullUnitParamValue value = { .f = command->value.f };
+  if (type != NULL_PARAM_F32) {
+    value.i = (int32_t)lroundf(command->value.f);
+  }
+
+  cancel_ramp(unit, command->param);
+  if (manager->ramp_free == NULL) {
+    // take back what freed units had
+    manager->ramp_free = atomic_exchange_explicit(&manager->ramp_returned, NULL, memory_order_acquire);
+  }
+  NullUnitRamp* ramp = manager->ramp_free;
+  if (type == NULL_PARAM_BOOL || command->duration == 0 || ramp == NULL) {
+    // nothing to ramp (or pool is empty), so just jump there
+    null_unit_set_param(unit, command->param, value);
+    return;
+  }
+  manager->ramp_free = ramp->next;
+
+  ramp->param = command->param;
+  ramp->from = type == NULL_PARAM_F32 ? unit->params[command->param].f : (float)unit->params[command->param].i;
+  ramp->to = command->value.f;
+  ramp->start = frame;
+  ramp->end = frame + command->duration;
+  ramp->curve = command->curve;
+  if (ramp->curve == NULL_RAMP_EXPONENTIAL && (ramp->from == 0.0f || ramp->to == 0.0f || (ramp->from < 0.0f) != (ramp->to < 0.0f))) {
+    ramp->curve = NULL_RAMP_LINEAR;
+  }
+  ramp->next = unit->ramps;
+  unit->ramps = ramp;
+}
+
+// audio thread: set every ramping param of a unit to where it should be at frame
+static void apply_ramps(NullUnit* unit, uint64_t frame) {
+  NullUnitRamp** link = &unit->ramps;
+  while (*link != NULL) {
+    NullUnitRamp* ramp = *link;
+    float value = ramp->to;
+    bool done = frame >= ramp->end;
+    if (!done) {
+      float t = (float)(frame - ramp->start) / (float)(ramp->end - ramp->start);
+      if (ramp->curve == NULL_RAMP_EXPONENTIAL) {
+        value = ramp->from * powf(ramp->to / ramp->from, t);
+      } else {
+        value = ramp->from + ((ramp->to - ramp->from) * t);
+      }
+    }
+
+    NullUnitParamValue v = { .f = value };
+    if (unit->info->params[ramp->param]->type != NULL_PARAM_F32) {
+      v.i = (int32_t)lroundf(value);
+    }
+    if (v.i != unit->params[ramp->param].i) {
+      null_unit_set_param(unit, ramp->param, v);
+    }
+
+    if (done) {
+      *link = ramp->next;
+      release_ramp(unit, ramp);
+    } else {
+      link = &ramp->next;
+    }
+  }
+}
+
+// audio thread: schedule a param-change in unit's (frame-ordered) event list
+static void schedule_event(NullUnitManager* manager, NullUnit* unit, NullCommand* command) {
+  if (manager->event_free == NULL) {
+    // take back what freed units had
+    manager->event_free = atomic_exchange_explicit(&manager->event_returned, NULL, memory_order_acquire);
+  }
+  NullUnitEvent* event = manager->event_free;
+  if (event == NULL) {
+    // pool is empty, so better late than never
+    set_param_now(unit, command->param, command->value);
+    return;
+  }
+  manager->event_free = event->next;
+  event->frame = command->frame;
+  event->param = command->param;
+  event->value = command->value;
+
+  // events at the same frame stay in the order they were sent
+  NullUnitEvent** link = &unit->events;
+  while (*link != NULL && (*link)->frame <= event->frame) {
+    link = &(*link)->next;
+  }
+  event->next = *link;
+  *link = event;
+}
+
+// audio thread: give all of a unit's events (and ramps) back to the pools
+static void clear_events(NullUnitManager* manager, NullUnit* unit) {
+  while (unit->events != NULL) {
+    NullUnitEvent* event = unit->events;
+    unit->events = event->next;
+    release_event(unit, event);
+  }
+  while (unit->ramps != NULL) {
+    cancel_ramp(unit, unit->ramps->param);
+  }
+  reclaim(manager, unit);
+}
+
+// audio thread: a voice for a note: one already on it, or a free one, or (all busy) one to steal
+static NullVoice* voice_pick(NullVoiceGroup* group, int note) {
+  for (unsigned int v = 0; v < group->voice_count; v++) {
+    if (group->voices[v].note == note) {
+      return &group->voices[v];
+    }
+  }
+  for (unsigned int v = 0; v < group->voice_count; v++) {
+    if (!group->voices[v].sounding) {
+      return &group->voices[v];
+    }
+  }
+  // ones ringing out after note-off go first, then the oldest (or quietest)
+  NullVoice* best = &group->voices[0];
+  for (unsigned int v = 1; v < group->voice_count; v++) {
+    NullVoice* voice = &group->voices[v];
+    if (voice->gate != best->gate) {
+      if (!voice->gate) {
+        best = voice;
+      }
+    } else if (group->steal == NULL_STEAL_QUIETEST ? voice->level < best->level : voice->started < best->started) {
+      best = voice;
+    }
+  }
+  return best;
+}
+
+// audio thread: start a note on a voice group (or stop it, at velocity 0)
+static void voice_note(NullUnitManager* manager, NullCommand* command, uint64_t blockStart) {
+  NullVoiceGroup* group = command->unit->group;
+  int note = (int)command->param;
+  float velocity = command->value.f;
+  if (group == NULL) {
+    return;
+  }
+
+  if (velocity <= 0.0f) {
+    for (unsigned int v = 0; v < group->voice_count; v++) {
+      NullVoice* voice = &group->voices[v];
+      if (voice->note != note || !voice->gate) {
+        continue;
+      }
+      voice->gate = false;
+      voice->quiet = 0;
+      for (unsigned int b = 0; b < group->binding_count; b++) {
+        NullVoiceBinding* binding = &group->bindings[b];
+        if (binding->role == NULL_VOICE_GATE) {
+          set_param_now(voice->units[binding->position], binding->param, (NullUnitParamValue){ .i=0 });
+        }
+      }
+      // nothing to ring out
+      if (!group->gated) {
+        voice->sounding = false;
+        voice->note = -1;
+      }
+    }
+    return;
+  }
+
+  NullVoice* voice = voice_pick(group, note);
+  bool stolen = voice->sounding;
+  voice->note = note;
+  voice->gate = true;
+  voice->sounding = true;
+  voice->started = blockStart;
+  voice->quiet = 0;
+  for (unsigned int b = 0; b < group->binding_count; b++) {
+    NullVoiceBinding* binding = &group->bindings[b];
+    NullUnit* unit = voice->units[binding->position];
+    NullUnitParamInfo* info = unit->info->params[binding->param];
+    NullUnitParamValue value = { .i=1 };
+    if (binding->role == NULL_VOICE_NOTE) {
+      if (info->type == NULL_PARAM_F32) {
+        value.f = (float)note;
+      } else {
+        value.i = note;
+      }
+    } else if (binding->role == NULL_VOICE_VELOCITY) {
+      if (info->type == NULL_PARAM_F32) {
+        value.f = info->min.f + (velocity * (info->max.f - info->min.f));
+      } else {
+        value.i = info->min.i + (int32_t)lroundf(velocity * (float)(info->max.i - info->min.i));
+      }
+    } else if (stolen) {
+      // gate drops for a frame, so envelopes start again
+      set_param_now(unit, binding->param, (NullUnitParamValue){ .i=0 });
+      NullCommand retrigger = { .param=binding->param, .value=value, .frame=blockStart + 1 };
+      schedule_event(manager, unit, &retrigger);
+      continue;
+    }
+    set_param_now(unit, binding->param, value);
+  }
+}
+
+// audio thread: apply queued commands, at a block boundary
+void null_manager_apply_commands(NullUnitManager* manager) {
+  NullCommand command;
+  uint64_t blockStart = atomic_load_explicit(&manager->frames, memory_order_relaxed);
+
+  // crossfade is done, so hand old plan back (there might not be room till next block)
+  if (manager->fade_plan != NULL && blockStart >= manager->fade_start + manager->fade_frames && null_ring_push(manager->completions, &manager->fade_done)) {
+    manager->fade_plan = NULL;
+  }
+
+  // only take a command when there is room to answer it (and to cut a crossfade short), so completions are never dropped
+  while (null_ring_free_count(manager->completions) > (manager->fade_plan != NULL ? 1 : 0) && null_ring_pop(manager->commands, &command)) {
+    // kept for xrun reports
+    atomic_store_explicit(&manager->last_command, command.type, memory_order_relaxed);
+    atomic_store_explicit(&manager->last_command_unit, command.unit != NULL ? command.unit->id : NULL_UNIT_INVALID, memory_order_relaxed);
+    atomic_store_explicit(&manager->last_command_frame, blockStart, memory_order_relaxed);
+    switch (command.type) {
+      case NULL_COMMAND_PLAN: {
+        // a new plan ends a crossfade right away
+        if (manager->fade_plan != NULL) {
+          null_ring_push(manager->completions, &manager->fade_done);
+          manager->fade_plan = NULL;
+        }
+        // hand old plan back, so control thread can free it (and units that were only in it)
+        NullUnitPlan* old = manager->plan;
+        manager->plan = command.plan;
+        command.plan = old;
+        if (command.duration > 0 && old != NULL) {
+          // old plan keeps playing (fading out) till the crossfade is done, and goes back then
+          manager->fade_plan = old;
+          manager->fade_done = command;
+          manager->fade_start = blockStart;
+          manager->fade_frames = command.duration;
+        } else {
+          null_ring_push(manager->completions, &command);
+        }
+        break;
+      }
+      case NULL_COMMAND_SET_PARAM:
+        if (command.frame <= blockStart) {
+          set_param_now(command.unit, command.param, command.value);
+        } else {
+          schedule_event(manager, command.unit, &command);
+        }
+        break;
+      case NULL_COMMAND_RAMP:
+        start_ramp(manager, command.unit, &command, blockStart);
+        break;
+      case NULL_COMMAND_UNLOAD:
+        clear_events(manager, command.unit);
+        break;
+      case NULL_COMMAND_NOTE:
+        voice_note(manager, &command, blockStart);
+        break;
+    }
+  }
+}
+
+// audio thread (or a worker): run a unit for a block, split at each scheduled param-change (so it lands on the exact frame)
+// while params are ramping, the unit gets a new value every NULL_RAMP_QUANTUM frames
+static void render_unit(NullUnitManager* manager, NullUnit* unit, uint64_t blockStart, unsigned int frames) {
+  unsigned int channels = manager->channels;
+  unsigned int offset = 0;
+  while (offset < frames) {
+    while (unit->events != NULL && unit->events->frame <= blockStart + offset) {
+      NullUnitEvent* event = unit->events;
+      unit->events = event->next;
+      set_param_now(unit, event->param, event->value);
+      release_event(unit, event);
+    }
+
+    unsigned int end = frames;
+    if (unit->events != NULL && unit->events->frame < blockStart + frames) {
+      end = unit->events->frame - blockStart;
+    }
+    if (unit->ramps != NULL) {
+      apply_ramps(unit, blockStart + offset);
+      if (end > offset + NULL_RAMP_QUANTUM) {
+        end = offset + NULL_RAMP_QUANTUM;
+      }
+      for (NullUnitRamp* ramp = unit->ramps; ramp != NULL; ramp = ramp->next) {
+        if (ramp->end < blockStart + end) {
+          end = ramp->end - blockStart;
+        }
+      }
+    }
+
+    double segmentTime = (double)(blockStart + offset) / manager->sample_rate;
+    if (!null_unit_process(unit, offset, end - offset, channels, manager->sample_rate, segmentTime)) {
+      memset(null_unit_block_out(unit) + (offset * channels), 0, (end - offset) * channels * sizeof(float));
+    }
+    offset = end;
+  }
+}
+
+// true if every sample of a block is under NULL_SILENCE (NaN isn't)
+static bool block_silent(const float* block, unsigned int samples) {
+  unsigned int s = 0;
+#if defined(__SSE2__)
+  const __m128 abs = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+  const __m128 silence = _mm_set1_ps(NULL_SILENCE);
+  __m128 loud = _mm_setzero_ps();
+  for (; s + 4 <= samples; s += 4) {
+    __m128 v = _mm_and_ps(_mm_loadu_ps(block + s), abs);
+    loud = _mm_or_ps(loud, _mm_cmpnle_ps(v, silence));
+  }
+  if (_mm_movemask_ps(loud) != 0) {
+    return false;
+  }
+#elif defined(__aarch64__)
+  const float32x4_t silence = vdupq_n_f32(NULL_SILENCE);
+  uint32x4_t loud = vdupq_n_u32(0);
+  for (; s + 4 <= samples; s += 4) {
+    float32x4_t v = vabsq_f32(vld1q_f32(block + s));
+    loud = vorrq_u32(loud, vmvnq_u32(vcleq_f32(v, silence)));
+  }
+  if (vmaxvq_u32(loud) != 0) {
+    return false;
+  }
+#endif
+  for (; s < samples; s++) {
+    if (!(fabsf(block[s]) <= NULL_SILENCE)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// audio thread (or a worker): clear a unit's output, once, for as long as it isn't run
+static void clear_output(NullUnitManager* manager, NullUnit* unit) {
+  if (!unit->cleared) {
+    memset(null_unit_block_out(unit), 0, manager->block * manager->channels * sizeof(float));
+    unit->cleared = true;
+  }
+}
+
+// audio thread (or a worker): does a param event (or ramp) land on a unit in this block? that wakes it
+static bool woken(NullUnit* unit, uint64_t blockStart, unsigned int frames) {
+  return unit->ramps != NULL || (unit->events != NULL && unit->events->frame < blockStart + frames);
+}
+
+// audio thread (or a worker): run a unit for a block, unless it's asleep (then its output is silence)
+// a unit that exports tail() sleeps once its input has been silent for longer than that, and wakes when it isn't.
+// one that exports sleeping() sleeps when it says so, till a param changes.
+static void render_awake(NullUnitManager* manager, NullUnit* unit, const float* in, uint64_t blockStart, unsigned int frames) {
+  if (unit->fn_tail != NULL) {
+    if (block_silent(in, frames * manager->channels)) {
+      if (unit->silent_frames == 0) {
+        unit->tail_frames = null_unit_tail(unit, manager->sample_rate);
+      }
+      unit->silent_frames += frames;
+    } else {
+      unit->silent_frames = 0;
+      unit->asleep = false;
+    }
+  }
+  if (woken(unit, blockStart, frames)) {
+    unit->asleep = false;
+  }
+  if (unit->asleep) {
+    clear_output(manager, unit);
+    return;
+  }
+
+  unit->cleared = false;
+  render_unit(manager, unit, blockStart, frames);
+  if (unit->fn_sleeping != NULL) {
+    unit->asleep = null_unit_sleeping(unit);
+  } else if (unit->fn_tail != NULL) {
+    unit->asleep = unit->silent_frames > unit->tail_frames;
+  }
+}
+
+// audio thread (or a worker): mix a voice group's sounding voices (they have all run), and let ones that rang out go idle
+static void render_voices(NullUnitManager* manager, NullUnit* unit, unsigned int frames) {
+  NullVoiceGroup* group = unit->group;
+  unsigned int samples = frames * manager->channels;
+  float* out = null_unit_block_out(unit);
+  memset(out, 0, samples * sizeof(float));
+  for (unsigned int v = 0; v < group->voice_count; v++) {
+    NullVoice* voice = &group->voices[v];
+    if (!voice->sounding) {
+      continue;
+    }
+    float* voiceOut = null_unit_block_out(voice->units[group->length - 1]);
+    float peak = 0.0f;
+    for (unsigned int s = 0; s < samples; s++) {
+      out[s] += voiceOut[s];
+      peak = fmaxf(peak, fabsf(voiceOut[s]));
+    }
+    voice->level = peak;
+    if (!voice->gate) {
+      voice->quiet = peak < NULL_VOICE_QUIET ? voice->quiet + 1 : 0;
+      if (voice->quiet >= NULL_VOICE_QUIET_BLOCKS) {
+        voice->sounding = false;
+        voice->note = -1;
+      }
+    }
+  }
+}
+
+// audio thread (or a worker): point a node at its input (or mix its inputs straight from upstream output blocks), then run it
+static void render_node(NullUnitManager* manager, NullUnitPlanNode* node, uint64_t blockStart, unsigned int frames) {
+  NullUnit* unit = node->unit;
+  unsigned int samples = frames * manager->channels;
+
+  // an idle voice (or a unit only sleeping units read) costs nothing: its output is cleared once, then it isn't run
+  if (!unit->demanded || (unit->voice != NULL && !unit->voice->sounding)) {
+    clear_output(manager, unit);
+    return;
+  }
+  if (unit->kind == NULL_UNIT_VOICES) {
+    unit->cleared = false;
+    render_voices(manager, unit, frames);
+    return;
+  }
+
+  if (unit->kind == NULL_UNIT_WASM) {
+    // unit memory moved (it can, without hardware bounds checks), so its view of the bus is gone
+    if (unit->bus_view != 0 && (uint8_t*)wasm_runtime_addr_app_to_native(unit->module_inst, unit->bus_view) != unit->bus_native) {
+      unit->bus_view = 0;
+    }
+
+    // one input (or none) from the bus: read it in place
+    if (node->window >= 0 && unit->bus_view != 0 && (node->input_count == 0 || null_unit_bus_out(node->inputs[0]))) {
+      unit->in_app = null_bus_window_app(manager->bus, unit, node->window);
+      render_awake(manager, unit, (const float*)wasm_runtime_addr_app_to_native(unit->module_inst, unit->in_app), blockStart, frames);
+      return;
+    }
+    unit->in_app = unit->block_in;
+  } else if (node->input_count == 1) {
+    // built-ins can read any block
+    unit->in_host = null_unit_block_out(node->inputs[0]);
+    render_awake(manager, unit, unit->in_host, blockStart, frames);
+    return;
+  } else {
+    unit->in_host = unit->host_block;
+  }
+
+  float* in = null_unit_block_in(unit);
+  if (node->input_count == 0) {
+    memset(in, 0, samples * sizeof(float));
+  } else {
+    memcpy(in, null_unit_block_out(node->inputs[0]), samples * sizeof(float));
+    for (unsigned int i = 1; i < node->input_count; i++) {
+      float* upstream = null_unit_block_out(node->inputs[i]);
+      for (unsigned int s = 0; s < samples; s++) {
+        in[s] += upstream[s];
+      }
+    }
+  }
+  render_awake(manager, unit, in, blockStart, frames);
+}
+
+// audio thread (or a worker): run a node, and time it
+void null_manager_render_node(NullUnitManager* manager, NullUnitPlanNode* node, uint64_t blockStart, unsigned int frames) {
+  uint64_t start = null_stats_now();
+  render_node(manager, node, blockStart, frames);
+  null_stats_record(&node->unit->stats, null_stats_now() - start, frames, manager->sample_rate);
+}
+
+// audio thread: run every unit in a plan for a block of frames
+static void render_plan(NullUnitManager* manager, NullUnitPlan* plan, uint64_t blockStart, unsigned int frames) {
+  // from audioOut back, find what needs to run: a sleeping unit (or idle voice) doesn't need its inputs,
+  // unless an event wakes it this block (then it needs them now, not a block later).
+  // with feedback, a unit can read one that runs after it, so everything runs.
+  for (unsigned int n = 0; n < plan->node_count; n++) {
+    plan->nodes[n].unit->demanded = plan->feedback;
+  }
+  if (!plan->feedback) {
+    for (unsigned int o = 0; o < plan->output_count; o++) {
+      plan->outputs[o]->demanded = true;
+    }
+    for (unsigned int n = plan->node_count; n-- > 0;) {
+      NullUnitPlanNode* node = &plan->nodes[n];
+      NullUnit* unit = node->unit;
+      if (!unit->demanded || (unit->asleep && unit->fn_sleeping != NULL && !woken(unit, blockStart, frames)) || (unit->voice != NULL && !unit->voice->sounding)) {
+        continue;
+      }
+      for (unsigned int i = 0; i < node->input_count; i++) {
+        node->inputs[i]->demanded = true;
+      }
+    }
+  }
+
+  // spread independent nodes over the workers, if there are any (and it's worth it)
+  NullWorkers* workers = atomic_load_explicit(&manager->workers, memory_order_acquire);
+  if (workers != NULL && plan->node_count > 1 && plan->node_count <= NULL_WORKER_DEQUE_SIZE) {
+    null_workers_render(workers, plan, blockStart, frames);
+  } else {
+    for (unsigned int n = 0; n < plan->node_count; n++) {
+      null_manager_render_node(manager, &plan->nodes[n], blockStart, frames);
+    }
+  }
+
+  for (unsigned int n = 0; n < plan->node_count; n++) {
+    reclaim(manager, plan->nodes[n].unit);
+  }
+}
+
+// audio thread: apply commands, and run every unit in the plan (and one crossfading out) for a block of frames
+void null_manager_render(NullUnitManager* manager, unsigned int frames) {
+  uint64_t start = null_stats_now();
+  null_workers_thread_init();
+  null_realtime_thread(manager, 0);
+  null_manager_apply_commands(manager);
+
+  NullUnitPlan* plan = manager->plan;
+  uint64_t blockStart = atomic_load_explicit(&manager->frames, memory_order_relaxed);
+  if (plan == NULL) {
+    atomic_store_explicit(&manager->frames, blockStart + frames, memory_order_relaxed);
+    return;
+  }
+
+  render_plan(manager, plan, blockStart, frames);
+  if (manager->fade_plan != NULL) {
+    render_plan(manager, manager->fade_plan, blockStart, frames);
+  }
+
+  atomic_store_explicit(&manager->frames, blockStart + frames, memory_order_relaxed);
+  uint64_t ns = null_stats_now() - start;
+  null_stats_record(&manager->stats, ns, frames, manager->sample_rate);
+  atomic_store_explicit(&manager->last_render_ns, ns, memory_order_relaxed);
+  atomic_store_explicit(&manager->last_render_frames, frames, memory_order_relaxed);
+  atomic_store_explicit(&manager->last_render_nodes, plan->node_count, memory_order_relaxed);
+}
+
+// audio thread: sum what's connected to audioOut for one (device) channel of the last rendered block
+// (crossfaded with the plan fading out, if there is one), dest is written every step bytes
+void null_manager_mix_output(NullUnitManager* manager, unsigned int frames, unsigned int channel, char* dest, int step) {
+  NullUnitPlan* plan = manager->plan;
+  NullUnitPlan* fade = manager->fade_plan;
+  uint64_t blockStart = atomic_load_explicit(&manager->frames, memory_order_relaxed) - frames;
+  unsigned int channels = manager->channels;
+  unsigned int unitChannel = channel < channels ? channel : channels - 1;
+  for (unsigned int frame = 0; frame < frames; frame++) {
+    float sample = 0.0f;
+    for (unsigned int o = 0; plan != NULL && o < plan->output_count; o++) {
+      sample += null_unit_block_out(plan->outputs[o])[(frame * channels) + unitChannel];
+    }
+    if (fade != NULL) {
+      float old = 0.0f;
+      for (unsigned int o = 0; o < fade->output_count; o++) {
+        old += null_unit_block_out(fade->outputs[o])[(frame * channels) + unitChannel];
+      }
+      float t = (float)(blockStart + frame - manager->fade_start) / (float)manager->fade_frames;
+      t = t < 1.0f ? t : 1.0f;
+      sample = (sample * t) + (old * (1.0f - t));
+    }
+    *(float*)(dest + (step * frame)) = sample;
+  }
+}
@@ -1,214 +1,1378 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "null_manager.h"
 #include "samples.h"
 
-// TODO: put these inside manager
-static struct SoundIo *soundio;
-static struct SoundIoDevice *device;
+// env.get_data_floats(id, offset, length, out): copy floats from a sample into unit memory (offset is in bytes, like the web host)
+static void native_get_data_floats(wasm_exec_env_t exec_env, uint32_t id, uint32_t offset, uint32_t length, uint32_t out) {
+  NullUnit* unit = (NullUnit*)wasm_runtime_get_user_data(exec_env);
+  wasm_module_inst_t module_inst = wasm_runtime_get_module_inst(exec_env);
+  if (unit == NULL || id >= cvector_size(unit->manager->samples)) {
+    return;
+  }
+  if (!wasm_runtime_validate_app_addr(module_inst, out, (uint64_t)length * sizeof(float))) {
+    return;
+  }
+  null_sample_read(unit, id, offset / sizeof(float), length, (float*)wasm_runtime_addr_app_to_native(module_inst, out));
+}
+
+// env.get_data_ptr(id): pointer to a sample, in the sample bank mapped into unit memory (read-only, no copy)
+// 0 if it's not mapped, then the unit should use get_data_floats
+static uint32_t native_get_data_ptr(wasm_exec_env_t exec_env, uint32_t id) {
+  NullUnit* unit = (NullUnit*)wasm_runtime_get_user_data(exec_env);
+  if (unit == NULL) {
+    return 0;
+  }
+  return null_unit_sample_app(unit, id);
+}
+
+// env.get_data_length(id): how many floats a sample has (0 if there is no sample)
+static uint32_t native_get_data_length(wasm_exec_env_t exec_env, uint32_t id) {
+  NullUnit* unit = (NullUnit*)wasm_runtime_get_user_data(exec_env);
+  if (unit == NULL || id >= cvector_size(unit->manager->samples)) {
+    return 0;
+  }
+  return unit->manager->samples[id].len / sizeof(float);
+}
+
+// env.get_data_channels(id): how many channels a sample has (its floats are interleaved), 0 if there is no sample
+static uint32_t native_get_data_channels(wasm_exec_env_t exec_env, uint32_t id) {
+  NullUnit* unit = (NullUnit*)wasm_runtime_get_user_data(exec_env);
+  if (unit == NULL || id >= cvector_size(unit->manager->samples)) {
+    return 0;
+  }
+  return unit->manager->samples[id].channels;
+}
+
+static NativeSymbol native_symbols[] = {
+  { "get_data_floats", native_get_data_floats, "(iiii)", NULL },
+  { "get_data_ptr", native_get_data_ptr, "(i)i", NULL },
+  { "get_data_length", native_get_data_length, "(i)i", NULL },
+  { "get_data_channels", native_get_data_channels, "(i)i", NULL }
+};
 
-// example, just to make sure sound is working
-static float seconds_offset = 0.0f;
+// read a little-endian u32 out of unit memory
+static uint32_t read_u32(uint8_t* p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+// get a native pointer to a range of unit memory, or NULL if it's out of bounds
+static uint8_t* unit_memory(NullUnit* unit, uint32_t offset, uint32_t size) {
+  if (!wasm_runtime_validate_app_addr(unit->module_inst, offset, size)) {
+    return NULL;
+  }
+  return (uint8_t*)wasm_runtime_addr_app_to_native(unit->module_inst, offset);
+}
+
+// copy a string out of unit memory
+static char* unit_string(NullUnit* unit, uint32_t offset) {
+  char* str = (char*)unit_memory(unit, offset, 1);
+  return strdup(str == NULL ? "" : str);
+}
+
+// call get_info() in unit and turn it into a host NullUnitnInfo (see layout in docs/unit-processor.js)
+static NullUnitnInfo* unit_read_info(NullUnit* unit, wasm_function_inst_t fn_get_info) {
+  wasm_val_t results[1] = { { .kind = WASM_I32 } };
+  if (!wasm_runtime_call_wasm_a(unit->exec_env, fn_get_info, 1, results, 0, NULL)) {
+    return NULL;
+  }
+
+  uint8_t* infoPtr = unit_memory(unit, results[0].of.i32, 12);
+  if (infoPtr == NULL) {
+    return NULL;
+  }
+
+  NullUnitnInfo* info = malloc(sizeof(NullUnitnInfo));
+  info->name = unit_string(unit, read_u32(infoPtr));
+  info->channelsIn = infoPtr[4];
+  info->channelsOut = infoPtr[5];
+  info->params = NULL;
+
+  uint8_t paramCount = infoPtr[6];
+  uint32_t paramsOffset = read_u32(infoPtr + 8);
+  for (uint8_t i = 0; i < paramCount; i++) {
+    uint8_t* paramPtr = unit_memory(unit, paramsOffset + (i * 20), 20);
+    if (paramPtr == NULL) {
+      break;
+    }
+    NullUnitParamInfo* param = malloc(sizeof(NullUnitParamInfo));
+    param->type = (NullUnitParamType)read_u32(paramPtr);
+    memcpy(&param->min, paramPtr + 4, 4);
+    memcpy(&param->max, paramPtr + 8, 4);
+    memcpy(&param->value, paramPtr + 12, 4);
+    param->name = unit_string(unit, read_u32(paramPtr + 16));
+    cvector_push_back(info->params, param);
+  }
+
+  return info;
+}
+
+static void unit_free_info(NullUnitnInfo* info) {
+  if (info == NULL) {
+    return;
+  }
+  for (size_t i = 0; i < cvector_size(info->params); i++) {
+    free(info->params[i]->name);
+    free(info->params[i]);
+  }
+  cvector_free(info->params);
+  free(info->name);
+  free(info);
+}
+
+// free a cached module
+static void module_free(NullUnitModule* module) {
+  wasm_runtime_unload(module->module);
+  null_manager_unmap_file(module->bytes, module->size);
+  free(module->path);
+  free(module);
+}
+
+// free a unit, and all it's wasm stuff
+static void unit_free(NullUnit* unit) {
+  if (unit->exec_env != NULL) {
+    if (unit->fn_destroy != NULL) {
+      wasm_runtime_call_wasm(unit->exec_env, unit->fn_destroy, 0, NULL);
+    }
+    wasm_runtime_destroy_exec_env(unit->exec_env);
+  }
+  if (unit->module_inst != NULL) {
+    wasm_runtime_deinstantiate(unit->module_inst);
+  }
+  if (unit->module != NULL) {
+    unit->module->refs--;
+  }
+  if (unit->group != NULL) {
+    for (unsigned int v = 0; v < unit->group->voice_count; v++) {
+      free(unit->group->voices[v].units);
+    }
+    free(unit->group->voices);
+    free(unit->group->bindings);
+    free(unit->group);
+  }
+  unit_free_info(unit->info);
+  free(unit->params);
+  free(unit->sample_apps);
+  free(unit->host_block);
+  null_bus_slot_free(unit->manager->bus, unit->bus_slot);
+  free(unit);
+}
+
+// get the interleaved input block of a loaded unit
+float* null_unit_block_in(NullUnit* unit) {
+  if (unit->kind != NULL_UNIT_WASM) {
+    return unit->host_block;
+  }
+  return (float*)wasm_runtime_addr_app_to_native(unit->module_inst, unit->block_in);
+}
+
+// get the interleaved output block of a loaded unit
+// is a unit's output in the bus (so a mapped unit can read it in place)?
+bool null_unit_bus_out(NullUnit* unit) {
+  return unit->bus_slot != 0 && (unit->kind != NULL_UNIT_WASM || unit->bus_view != 0);
+}
+
+float* null_unit_block_out(NullUnit* unit) {
+  if (null_unit_bus_out(unit)) {
+    return null_bus_slot(unit->manager->bus, unit->bus_slot);
+  }
+  if (unit->kind != NULL_UNIT_WASM) {
+    return unit->host_block + (unit->manager->block * NULL_MAX_CHANNELS);
+  }
+  return (float*)wasm_runtime_addr_app_to_native(unit->module_inst, unit->block_out);
+}
+
+// built-in osc: loop over one of the shared mini-samples (sin/sqr/tri/saw)
+static void builtin_osc_process(NullUnit* unit, unsigned int offset, unsigned int frames, unsigned int channels, float sampleRate) {
+  float* out = null_unit_block_out(unit) + (offset * channels);
+  int type = unit->params[0].i;
+  float note = unit->params[1].f;
+  if (type < 0 || type >= (int)cvector_size(unit->manager->samples)) {
+    type = 0;
+  }
+  NullUnitSample* sample = &unit->manager->samples[type];
+  unsigned int sampleLen = sample->len / sizeof(float);
+  float step = (440.0f * powf(2.0f, (note - 69.0f) / 12.0f)) / sampleRate;
+
+  for (unsigned int i = 0; i < frames; i++) {
+    float value = sample->data[(unsigned int)(unit->phase * sampleLen) % sampleLen];
+    for (unsigned int channel = 0; channel < channels; channel++) {
+      out[(i * channels) + channel] = value;
+    }
+    unit->phase += step;
+    unit->phase -= floorf(unit->phase);
+  }
+}
+
+// audio thread: set a param in a unit
+void null_unit_set_param(NullUnit* unit, unsigned int paramId, NullUnitParamValue value) {
+  if (paramId >= unit->param_count) {
+    return;
+  }
+  unit->params[paramId] = value;
+  if (unit->kind != NULL_UNIT_WASM || unit->fn_param_set == NULL) {
+    return;
+  }
+  *(NullUnitParamValue*)wasm_runtime_addr_app_to_native(unit->module_inst, unit->param_value) = value;
+  uint32_t argv[2] = { paramId, unit->param_value };
+  if (!wasm_runtime_call_wasm(unit->exec_env, unit->fn_param_set, 2, argv)) {
+    wasm_runtime_clear_exception(unit->module_inst);
+  }
+}
+
+// run frames (starting at offset) of a block through a unit, with process_block if it has it, or process() for each sample
+bool null_unit_process(NullUnit* unit, unsigned int offset, unsigned int frames, unsigned int channels, float sampleRate, double blockTime) {
+  if (unit->kind == NULL_UNIT_OSC) {
+    builtin_osc_process(unit, offset, frames, channels, sampleRate);
+    return true;
+  }
+  if (unit->kind != NULL_UNIT_WASM) {
+    return true;
+  }
+
+  // output goes straight to the bus, if unit has it mapped
+  uint32_t out = unit->bus_view != 0 ? null_bus_window_app(unit->manager->bus, unit, 0) : unit->block_out;
+
+  if (unit->fn_process_block != NULL) {
+    uint32_t offsetBytes = offset * channels * sizeof(float);
+    wasm_val_t args[6] = {
+      { .kind = WASM_I32, .of.i32 = unit->in_app + offsetBytes },
+      { .kind = WASM_I32, .of.i32 = out + offsetBytes },
+      { .kind = WASM_I32, .of.i32 = frames },
+      { .kind = WASM_I32, .of.i32 = channels },
+      { .kind = WASM_F32, .of.f32 = sampleRate },
+      { .kind = WASM_F64, .of.f64 = blockTime }
+    };
+    if (!wasm_runtime_call_wasm_a(unit->exec_env, unit->fn_process_block, 0, NULL, 6, args)) {
+      wasm_runtime_clear_exception(unit->module_inst);
+      return false;
+    }
+    return true;
+  }
+
+  // older units: cross into wasm once per sample (channel-major, like the web worklet)
+  wasm_val_t args[5] = {
+    { .kind = WASM_I32 },
+    { .kind = WASM_F32 },
+    { .kind = WASM_I32 },
+    { .kind = WASM_F32, .of.f32 = sampleRate },
+    { .kind = WASM_F64, .of.f64 = blockTime }
+  };
+  wasm_val_t results[1] = { { .kind = WASM_F32 } };
+  for (unsigned int channel = 0; channel < channels; channel++) {
+    args[2].of.i32 = channel;
+    for (unsigned int i = offset; i < offset + frames; i++) {
+      // re-resolve every call, since memory can move if the unit grows it
+      float* in = (float*)wasm_runtime_addr_app_to_native(unit->module_inst, unit->in_app);
+      args[0].of.i32 = unit->position++;
+      args[1].of.f32 = in[(i * channels) + channel];
+      if (!wasm_runtime_call_wasm_a(unit->exec_env, unit->fn_process, 1, results, 5, args)) {
+        wasm_runtime_clear_exception(unit->module_inst);
+        return false;
+      }
+      float* out = null_unit_block_out(unit);
+      out[(i * channels) + channel] = isnan(results[0].of.f32) ? 0.0f : results[0].of.f32;
+    }
+  }
+  return true;
+}
+
+// audio thread: how many frames a unit's output goes on for once its input is silent
+uint32_t null_unit_tail(NullUnit* unit, float sampleRate) {
+  wasm_val_t args[1] = { { .kind = WASM_F32, .of.f32 = sampleRate } };
+  wasm_val_t results[1] = { { .kind = WASM_I32 } };
+  if (!wasm_runtime_call_wasm_a(unit->exec_env, unit->fn_tail, 1, results, 1, args)) {
+    wasm_runtime_clear_exception(unit->module_inst);
+    return UINT32_MAX;
+  }
+  return (uint32_t)results[0].of.i32;
+}
+
+// audio thread: true if a unit says its output will be silent till a param changes
+bool null_unit_sleeping(NullUnit* unit) {
+  wasm_val_t results[1] = { { .kind = WASM_I32 } };
+  if (!wasm_runtime_call_wasm_a(unit->exec_env, unit->fn_sleeping, 1, results, 0, NULL)) {
+    wasm_runtime_clear_exception(unit->module_inst);
+    return false;
+  }
+  return results[0].of.i32 != 0;
+}
+
+// libsoundio says the device ran out of frames
+static void underflow_callback(struct SoundIoOutStream *outstream) {
+  null_xrun_record((NullUnitManager*)outstream->userdata);
+}
+
+// audio thread: render a quantum (manager->block frames), and mix what's connected to audioOut into the FIFO (interleaved)
+static void render_quantum(NullUnitManager* manager, int deviceChannels) {
+  float* dest = (float*)soundio_ring_buffer_write_ptr(manager->fifo);
+  null_manager_render(manager, manager->block);
+  for (int channel = 0; channel < deviceChannels; channel++) {
+    null_manager_mix_output(manager, manager->block, channel, (char*)(dest + channel), deviceChannels * sizeof(float));
+  }
+  soundio_ring_buffer_advance_write_ptr(manager->fifo, manager->block * deviceChannels * sizeof(float));
+}
+
+// libsoundio asks for frames (any number of them): units always render a whole quantum, into a FIFO the device
+// takes from, so they get the same block size every time, for at most a quantum more latency
 static void write_callback(struct SoundIoOutStream *outstream, int frame_count_min, int frame_count_max) {
   NullUnitManager *manager = (NullUnitManager*)outstream->userdata;
-  (void)manager;
-
   const struct SoundIoChannelLayout *layout = &outstream->layout;
-     float float_sample_rate = outstream->sample_rate;
-     float seconds_per_frame = 1.0f / float_sample_rate;
-     struct SoundIoChannelArea *areas;
-     int frames_left = frame_count_max;
-     int err;
+  struct SoundIoChannelArea *areas;
+  int frames_left = frame_count_max;
+  int err;
+
+  while (frames_left > 0) {
+    int frame_count = frames_left;
+
+    if ((err = soundio_outstream_begin_write(outstream, &areas, &frame_count))) {
+      fprintf(stderr, "%s\n", soundio_strerror(err));
+      exit(1);
+    }
+
+    if (!frame_count) {
+      break;
+    }
+
+    int channels = layout->channel_count;
+    int frameBytes = channels * sizeof(float);
+    for (int offset = 0; offset < frame_count;) {
+      if (soundio_ring_buffer_fill_count(manager->fifo) < frameBytes) {
+        render_quantum(manager, channels);
+      }
+      int ready = soundio_ring_buffer_fill_count(manager->fifo) / frameBytes;
+      int frames = frame_count - offset < ready ? frame_count - offset : ready;
+      const float* src = (const float*)soundio_ring_buffer_read_ptr(manager->fifo);
+      for (int channel = 0; channel < channels; channel++) {
+        char* dest = areas[channel].ptr + (areas[channel].step * offset);
+        for (int frame = 0; frame < frames; frame++) {
+          *(float*)(dest + (areas[channel].step * frame)) = src[(frame * channels) + channel];
+        }
+      }
+      soundio_ring_buffer_advance_read_ptr(manager->fifo, frames * frameBytes);
+      offset += frames;
+    }
 
-     while (frames_left > 0) {
-         int frame_count = frames_left;
+    if ((err = soundio_outstream_end_write(outstream))) {
+      fprintf(stderr, "%s\n", soundio_strerror(err));
+      exit(1);
+    }
 
-         if ((err = soundio_outstream_begin_write(outstream, &areas, &frame_count))) {
-             fprintf(stderr, "%s\n", soundio_strerror(err));
-             exit(1);
-         }
+    frames_left -= frame_count;
+  }
+}
 
-         if (!frame_count)
-             break;
+// run often on the control thread (put in your update-loop)
+// control thread: show scheduled param changes the audio thread has got to in their units' info
+static void pending_params_apply(NullUnitManager* manager) {
+  uint64_t frames = atomic_load_explicit(&manager->frames, memory_order_relaxed);
+  size_t done = 0;
+  while (done < cvector_size(manager->pending_params) && manager->pending_params[done].frame < frames) {
+    NullParamPending* pending = &manager->pending_params[done];
+    pending->unit->info->params[pending->param]->value = pending->value;
+    done++;
+  }
+  if (done > 0) {
+    memmove(manager->pending_params, manager->pending_params + done, (cvector_size(manager->pending_params) - done) * sizeof(NullParamPending));
+    cvector_set_size(manager->pending_params, cvector_size(manager->pending_params) - done);
+  }
+}
+
+void null_manager_process(NullUnitManager* manager) {
+  if (manager->soundio != NULL) {
+    soundio_flush_events(manager->soundio);
+  }
 
-         float pitch = 440.0f;
-         float radians_per_second = pitch * 2.0f * M_PI;
-         for (int frame = 0; frame < frame_count; frame += 1) {
-             float sample = sinf((seconds_offset + frame * seconds_per_frame) * radians_per_second);
-             for (int channel = 0; channel < layout->channel_count; channel += 1) {
-                 float *ptr = (float*)(areas[channel].ptr + areas[channel].step * frame);
-                 *ptr = sample;
-             }
-         }
-         seconds_offset = fmodf(seconds_offset +
-             seconds_per_frame * frame_count, 1.0f);
+  null_xruns_collect(manager);
+
+  // free plans audio thread is done with
+  NullCommand completion;
+  while (null_ring_pop(manager->completions, &completion)) {
+    if (completion.type == NULL_COMMAND_PLAN) {
+      null_plan_free(completion.plan);
+      manager->plan_serial = completion.serial;
+    }
+  }
 
-         if ((err = soundio_outstream_end_write(outstream))) {
-             fprintf(stderr, "%s\n", soundio_strerror(err));
-             exit(1);
-         }
+  pending_params_apply(manager);
 
-         frames_left -= frame_count;
-     }
+  // free unloaded units, once audio thread is on a plan without them
+  for (size_t i = 0; i < cvector_size(manager->garbage);) {
+    if (manager->garbage[i].serial <= manager->plan_serial) {
+      for (size_t p = 0; p < cvector_size(manager->pending_params);) {
+        if (manager->pending_params[p].unit == manager->garbage[i].unit) {
+          cvector_erase(manager->pending_params, p);
+        } else {
+          p++;
+        }
+      }
+      null_unit_return_events(manager, manager->garbage[i].unit);
+      null_unit_free(manager->garbage[i].unit);
+      cvector_erase(manager->garbage, i);
+    } else {
+      i++;
+    }
+  }
+}
+
+// control thread: push commands to the audio thread all at once (waits a bit if the ring doesn't have room)
+static bool send_commands(NullUnitManager* manager, NullCommand* commands, unsigned int count) {
+  for (int tries = 0; tries < 1000; tries++) {
+    if (null_ring_push_many(manager->commands, commands, count)) {
+      return true;
+    }
+    // audio thread is behind, so make room for its completions and give it a moment
+    null_manager_process(manager);
+    if (manager->offline) {
+      // no audio thread, this one renders
+      null_manager_apply_commands(manager);
+    } else {
+      usleep(1000);
+    }
+  }
+  return false;
 }
 
-// run on every audio-frame (put in your update-loop)
-void null_manager_process() {
-  soundio_wait_events(soundio);
+// control thread: queue a command for the audio thread (waits a bit if the ring is full)
+bool null_manager_send(NullUnitManager* manager, NullCommand* command) {
+  if (manager->batch_depth > 0) {
+    cvector_push_back(manager->batch, *command);
+    return true;
+  }
+  if (!send_commands(manager, command, 1)) {
+    fprintf(stderr, "Command queue is full, dropping command\n");
+    return false;
+  }
+  return true;
 }
 
+// start a batch (see null_manager_batch_end)
+void null_manager_batch_begin(NullUnitManager* manager) {
+  manager->batch_depth++;
+}
+
+// end a batch: one compile, and every command (plan last) in the ring at once, so it all goes live in one block
+void null_manager_batch_end(NullUnitManager* manager) {
+  if (manager->batch_depth == 0 || --manager->batch_depth > 0) {
+    return;
+  }
+  if (manager->batch_compile) {
+    manager->batch_compile = false;
+    NullUnitPlan* plan = null_plan_compile(manager);
+    NullCommand command = {
+      .type = NULL_COMMAND_PLAN,
+      .plan = plan,
+      .serial = plan->serial
+    };
+    cvector_push_back(manager->batch, command);
+  }
+
+  // a batch bigger than the ring can't go at once, so it goes in ring-sized parts (the plan is in the last one)
+  unsigned int count = cvector_size(manager->batch);
+  if (count > NULL_RING_SIZE) {
+    fprintf(stderr, "Batch of %u commands is bigger than the command queue, it will go live over a few blocks\n", count);
+  }
+  for (unsigned int sent = 0; sent < count;) {
+    unsigned int part = count - sent < NULL_RING_SIZE ? count - sent : NULL_RING_SIZE;
+    if (!send_commands(manager, manager->batch + sent, part)) {
+      fprintf(stderr, "Command queue is full, dropping %u commands\n", count - sent);
+      for (; sent < count; sent++) {
+        if (manager->batch[sent].type == NULL_COMMAND_PLAN) {
+          null_plan_free(manager->batch[sent].plan);
+        }
+      }
+      break;
+    }
+    sent += part;
+  }
+  cvector_clear(manager->batch);
+}
+
+// make a built-in (host-side) unit
+NullUnit* null_unit_builtin(NullUnitManager* manager, NullUnitKind kind, const char* name, uint8_t channelsIn, uint8_t channelsOut) {
+  NullUnit* unit = calloc(1, sizeof(NullUnit));
+  unit->manager = manager;
+  unit->kind = kind;
+  unit->active = true;
+  unit->host_block = calloc(manager->block * NULL_MAX_CHANNELS * 2, sizeof(float));
+  unit->in_host = unit->host_block;
+  if (kind != NULL_UNIT_OUT) {
+    unit->bus_slot = null_bus_slot_alloc(manager->bus);
+  }
+  unit->info = malloc(sizeof(NullUnitnInfo));
+  unit->info->name = strdup(name);
+  unit->info->channelsIn = channelsIn;
+  unit->info->channelsOut = channelsOut;
+  unit->info->params = NULL;
+  return unit;
+}
+
+// add a param to a built-in unit
+static void builtin_param(NullUnit* unit, const char* name, NullUnitParamType type, NullUnitParamValue min, NullUnitParamValue max, NullUnitParamValue value) {
+  NullUnitParamInfo* param = malloc(sizeof(NullUnitParamInfo));
+  param->type = type;
+  param->min = min;
+  param->max = max;
+  param->value = value;
+  param->name = strdup(name);
+  cvector_push_back(unit->info->params, param);
+  unit->params = realloc(unit->params, cvector_size(unit->info->params) * sizeof(NullUnitParamValue));
+  unit->params[cvector_size(unit->info->params) - 1] = value;
+  unit->param_count = cvector_size(unit->info->params);
+}
+
+// Initialize the manager, without an audio device
+NullUnitManager* null_manager_create_offline(unsigned int sampleRate, unsigned int channels, unsigned int block) {
+  NullUnitManager* manager = calloc(1, sizeof(NullUnitManager));
+  manager->offline = true;
+  manager->sample_rate = sampleRate > 0 ? sampleRate : SAMPLE_RATE;
+  manager->channels = channels < NULL_MAX_CHANNELS ? channels : NULL_MAX_CHANNELS;
+  manager->block = block == 0 ? FRAMES_PER_BUFFER : block < NULL_MAX_BLOCK ? block : NULL_MAX_BLOCK;
+
+  // WAMR first, so there is nothing else to undo if it fails
+  RuntimeInitArgs init_args;
+  memset(&init_args, 0, sizeof(RuntimeInitArgs));
+  init_args.mem_alloc_type = Alloc_With_System_Allocator;
+  init_args.native_module_name = "env";
+  init_args.native_symbols = native_symbols;
+  init_args.n_native_symbols = sizeof(native_symbols) / sizeof(NativeSymbol);
+  if (!wasm_runtime_full_init(&init_args)) {
+    fprintf(stderr, "Could not initialize wasm runtime\n");
+    free(manager);
+    return NULL;
+  }
+
+  manager->commands = malloc(sizeof(NullRing));
+  manager->completions = malloc(sizeof(NullRing));
+  null_ring_init(manager->commands);
+  null_ring_init(manager->completions);
+
+  // all scheduled param-changes come from this, so audio thread never allocates them
+  manager->event_pool = calloc(NULL_EVENT_POOL_SIZE, sizeof(NullUnitEvent));
+  for (int i = 0; i < NULL_EVENT_POOL_SIZE - 1; i++) {
+    manager->event_pool[i].next = &manager->event_pool[i + 1];
+  }
+  manager->event_free = manager->event_pool;
+
+  // same for ramps
+  manager->ramp_pool = calloc(NULL_RAMP_POOL_SIZE, sizeof(NullUnitRamp));
+  for (int i = 0; i < NULL_RAMP_POOL_SIZE - 1; i++) {
+    manager->ramp_pool[i].next = &manager->ramp_pool[i + 1];
+  }
+  manager->ramp_free = manager->ramp_pool;
+
+  manager->bus = null_bus_create(manager->block);
+  manager->sample_fd = -1;
+  pthread_mutex_init(&manager->unit_lock, NULL);
+  atomic_init(&manager->realtime_serial, 1);
+
+  // index 0 is audioOut
+  NullUnit* audioOut = null_unit_builtin(manager, NULL_UNIT_OUT, "out", 1, 0);
+  cvector_push_back(manager->units, audioOut);
+
+  // track built-ins
+  NullUnitAvailable unitForList = (NullUnitAvailable){
+    .name="out",
+    .path=NULL
+  };
+  cvector_push_back(manager->available_units, unitForList);
+  unitForList.name = strdup("osc");
+  cvector_push_back(manager->available_units, unitForList);
+
+  // load built-in samples
+  null_manager_add_sample(manager, (float*)samples_sin_raw, samples_sin_raw_len);
+  null_manager_add_sample(manager, (float*)samples_sqr_raw, samples_sqr_raw_len);
+  null_manager_add_sample(manager, (float*)samples_tri_raw, samples_tri_raw_len);
+  null_manager_add_sample(manager, (float*)samples_saw_raw, samples_saw_raw_len);
+
+  // empty plan, so audio thread has something to render
+  null_manager_compile(manager);
+
+  return manager;
+}
+
+// connect to a backend by name (any that works, if name is NULL)
+static int connect_backend(struct SoundIo* soundio, const char* name) {
+  if (name == NULL) {
+    return soundio_connect(soundio);
+  }
+  for (int i = 0; i < soundio_backend_count(soundio); i++) {
+    enum SoundIoBackend backend = soundio_get_backend(soundio, i);
+    if (strcasecmp(soundio_backend_name(backend), name) == 0) {
+      return soundio_connect_backend(soundio, backend);
+    }
+  }
+  fprintf(stderr, "No %s backend, it can be one of:", name);
+  for (int i = 0; i < soundio_backend_count(soundio); i++) {
+    fprintf(stderr, " %s", soundio_backend_name(soundio_get_backend(soundio, i)));
+  }
+  fprintf(stderr, "\n");
+  return SoundIoErrorBackendUnavailable;
+}
+
+// index of an output device by id, name, or index (the default, if name is NULL), -1 if there isn't one
+static int find_device(struct SoundIo* soundio, const char* name) {
+  if (name == NULL) {
+    return soundio_default_output_device_index(soundio);
+  }
+  int count = soundio_output_device_count(soundio);
+  for (int i = 0; i < count; i++) {
+    struct SoundIoDevice* device = soundio_get_output_device(soundio, i);
+    bool match = !device->is_raw && (strcmp(device->id, name) == 0 || strcmp(device->name, name) == 0);
+    soundio_device_unref(device);
+    if (match) {
+      return i;
+    }
+  }
+  char* end;
+  long index = strtol(name, &end, 10);
+  if (*end == '\0' && index >= 0 && index < count) {
+    return (int)index;
+  }
+  fprintf(stderr, "No output device %s, it can be one of:\n", name);
+  for (int i = 0; i < count; i++) {
+    struct SoundIoDevice* device = soundio_get_output_device(soundio, i);
+    if (!device->is_raw) {
+      fprintf(stderr, "  %d: %s (%s)\n", i, device->name, device->id);
+    }
+    soundio_device_unref(device);
+  }
+  return -1;
+}
 
 // Initialize the audio system and manager
-NullUnitManager* null_manager_create() {
-  NullUnitManager* manager =  malloc(sizeof(NullUnitManager));
-  manager->units = NULL;
-  manager->samples = NULL;
-  manager->available_units = NULL;
+// the device is opened first, so units are set up for the rate (and block) it ends up with
+NullUnitManager* null_manager_create(const NullAudioConfig* config) {
+  NullAudioConfig defaults = { 0 };
+  if (config == NULL) {
+    config = &defaults;
+  }
 
-  soundio = soundio_create();
+  struct SoundIo* soundio = soundio_create();
   if (!soundio) {
       fprintf(stderr, "Out of memory\n");
-      null_manager_destroy(manager);
       return NULL;
   }
 
-  int err = soundio_connect(soundio);
+  int err = connect_backend(soundio, config->backend);
   if (err) {
       fprintf(stderr, "Error connecting: %s\n", soundio_strerror(err));
-      null_manager_destroy(manager);
+      soundio_destroy(soundio);
       return NULL;
   }
 
   soundio_flush_events(soundio);
 
-  int default_out_device_index = soundio_default_output_device_index(soundio);
-  if (default_out_device_index < 0) {
+  int out_device_index = find_device(soundio, config->device);
+  if (out_device_index < 0) {
       fprintf(stderr, "No output device found\n");
-      null_manager_destroy(manager);
+      soundio_destroy(soundio);
       return NULL;
   }
 
-  device = soundio_get_output_device(soundio, default_out_device_index);
+  struct SoundIoDevice* device = soundio_get_output_device(soundio, out_device_index);
   if (!device) {
       fprintf(stderr, "Out of memory\n");
-      null_manager_destroy(manager);
+      soundio_destroy(soundio);
       return NULL;
   }
 
-  manager->outstream = soundio_outstream_create(device);
-  if (!manager->outstream) {
+  struct SoundIoOutStream* outstream = soundio_outstream_create(device);
+  if (!outstream) {
     fprintf(stderr, "Out of memory\n");
-    null_manager_destroy(manager);
+    soundio_device_unref(device);
+    soundio_destroy(soundio);
     return NULL;
   }
 
-  manager->outstream->format = SoundIoFormatFloat32NE;
-  manager->outstream->sample_rate = SAMPLE_RATE;
-  manager->outstream->write_callback = write_callback;
-  manager->outstream->userdata = &manager;
+  unsigned int rate = config->sample_rate > 0 ? config->sample_rate : SAMPLE_RATE;
+  outstream->format = SoundIoFormatFloat32NE;
+  outstream->sample_rate = soundio_device_supports_sample_rate(device, rate) ? (int)rate : soundio_device_nearest_sample_rate(device, rate);
+  outstream->software_latency = config->latency > 0.0 ? config->latency : 0.0;
+  outstream->write_callback = write_callback;
+  outstream->underflow_callback = underflow_callback;
 
-  if ((err = soundio_outstream_open(manager->outstream))) {
+  if ((err = soundio_outstream_open(outstream))) {
     fprintf(stderr, "Unable to open device: %s\n", soundio_strerror(err));
+    soundio_outstream_destroy(outstream);
+    soundio_device_unref(device);
+    soundio_destroy(soundio);
+    return NULL;
+  }
+  if ((unsigned int)outstream->sample_rate != rate) {
+    fprintf(stderr, "%s can't run at %u Hz, using %d Hz\n", device->name, rate, outstream->sample_rate);
+  }
+
+  // units run with the block asked for, or one that fits in the latency the device gave (so a callback is a block or two)
+  unsigned int block = config->block;
+  unsigned int latencyFrames = (unsigned int)(outstream->software_latency * outstream->sample_rate);
+  if (block == 0) {
+    block = FRAMES_PER_BUFFER;
+    while (block > 32 && latencyFrames > 0 && block > latencyFrames) {
+      block /= 2;
+    }
+  }
+
+  // units run with (up to) as many channels as the device has
+  NullUnitManager* manager = null_manager_create_offline(outstream->sample_rate, outstream->layout.channel_count, block);
+  if (manager == NULL) {
+    soundio_outstream_destroy(outstream);
+    soundio_device_unref(device);
+    soundio_destroy(soundio);
+    return NULL;
+  }
+  manager->offline = false;
+  manager->soundio = soundio;
+  manager->device = device;
+  manager->outstream = outstream;
+  outstream->userdata = manager;
+
+  // a quantum is rendered only when the FIFO is empty, so it never holds more than one
+  manager->fifo = soundio_ring_buffer_create(soundio, manager->block * outstream->layout.channel_count * sizeof(float));
+  if (manager->fifo == NULL) {
+    fprintf(stderr, "Out of memory\n");
     null_manager_destroy(manager);
     return NULL;
   }
 
-  if ((err = soundio_outstream_start(manager->outstream))) {
+  printf("audio: %s, %s, %u Hz, %d channels, block %u, latency %.2fms (%u frames)\n",
+    soundio_backend_name(soundio->current_backend), device->name, manager->sample_rate, outstream->layout.channel_count,
+    manager->block, outstream->software_latency * 1000.0, latencyFrames);
+  if (config->latency > 0.0 && outstream->software_latency > config->latency * 1.01) {
+    fprintf(stderr, "Asked for %.2fms latency, the device gave %.2fms\n", config->latency * 1000.0, outstream->software_latency * 1000.0);
+  }
+
+  if ((err = soundio_outstream_start(outstream))) {
     fprintf(stderr, "Unable to start device: %s\n", soundio_strerror(err));
     null_manager_destroy(manager);
     return NULL;
   }
 
-  // index 0 is audioOut
-  NullUnit* audioOut = malloc(sizeof(NullUnit));
-  audioOut->active = true;
-  audioOut->info = malloc(sizeof(NullUnitnInfo));
-  audioOut->info->name = strdup("out");
-  audioOut->info->channelsIn = 1;
-  audioOut->info->channelsOut = 0;
-  audioOut->info->params = NULL;
+  return manager;
+}
 
-  // TODO: setup input_buffer/output_buffer for osc/audioOut
+// Clean up
+void null_manager_destroy(NullUnitManager* manager) {
+  if (manager->outstream != NULL){
+    soundio_outstream_destroy(manager->outstream);
+  }
+  if (manager->fifo != NULL) {
+    soundio_ring_buffer_destroy(manager->fifo);
+  }
+  if (manager->device != NULL) {
+    soundio_device_unref(manager->device);
+  }
+  if (manager->soundio != NULL) {
+    soundio_destroy(manager->soundio);
+  }
+  null_workers_free(atomic_load(&manager->workers));
+  cvector_free(manager->realtime.cpus);
+  null_aot_cache_free(manager->aot_cache);
 
-  cvector_push_back(manager->units, audioOut);
+  // audio has stopped, so everything can go
+  NullCommand command;
+  while (null_ring_pop(manager->commands, &command)) {
+    if (command.type == NULL_COMMAND_PLAN) {
+      null_plan_free(command.plan);
+    }
+  }
+  while (null_ring_pop(manager->completions, &command)) {
+    if (command.type == NULL_COMMAND_PLAN) {
+      null_plan_free(command.plan);
+    }
+  }
+  null_plan_free(manager->plan);
+  null_plan_free(manager->fade_plan);
+  for (size_t i = 0; i < cvector_size(manager->garbage); i++) {
+    unit_free(manager->garbage[i].unit);
+  }
+  for (size_t i = 0; i < cvector_size(manager->units); i++) {
+    if (manager->units[i] != NULL) {
+      unit_free(manager->units[i]);
+    }
+  }
+  cvector_free(manager->garbage);
+  cvector_free(manager->pending_params);
+  cvector_free(manager->batch);
+  for (size_t i = 0; i < cvector_size(manager->modules); i++) {
+    module_free(manager->modules[i]);
+  }
+  cvector_free(manager->modules);
+  for (size_t i = 0; i < cvector_size(manager->file_hashes); i++) {
+    free(manager->file_hashes[i].path);
+  }
+  cvector_free(manager->file_hashes);
+  null_bus_free(manager->bus);
+  cvector_free(manager->connections);
+  cvector_free(manager->units);
+  free(manager->commands);
+  free(manager->completions);
+  free(manager->event_pool);
+  free(manager->ramp_pool);
+  null_manager_free_samples(manager);
+  pthread_mutex_destroy(&manager->unit_lock);
+  wasm_runtime_destroy();
+  free(manager);
+}
 
-  // track built-ins
-  NullUnitAvailable unitForList = (NullUnitAvailable){
-    .name="out",
-    .path=NULL
-  };
-  cvector_push_back(manager->available_units, unitForList);
-  unitForList.name = strdup("osc");
-  cvector_push_back(manager->available_units, unitForList);
+// AOT cache, set up the first time it's needed
+static NullAotCache* unit_aot_cache(NullUnitManager* manager) {
+  if (!manager->aot_cache_tried && (manager->engine == NULL_ENGINE_AUTO || manager->engine == NULL_ENGINE_AOT)) {
+    manager->aot_cache_tried = true;
+    manager->aot_cache = null_aot_cache_create();
+  }
+  return manager->aot_cache;
+}
 
-  // load built-in samples
-  NullUnitSample sample = { .len=samples_sin_raw_len, .data=(float*)samples_sin_raw };
-  cvector_push_back(manager->samples, sample);
+// .aot made by wamrc from a .wasm (same name, next to it), if engine wants one and it's not older than the .wasm
+static bool unit_aot_sidecar(NullUnitManager* manager, const char* path, char* out, size_t size) {
+  if (!NULL_WAMR_AOT || (manager->engine != NULL_ENGINE_AUTO && manager->engine != NULL_ENGINE_AOT)) {
+    return false;
+  }
+  const char* ext = strrchr(path, '.');
+  size_t baseLen = ext != NULL && strcmp(ext, ".wasm") == 0 ? (size_t)(ext - path) : strlen(path);
+  if (baseLen + 5 > size) {
+    return false;
+  }
+  memcpy(out, path, baseLen);
+  strcpy(out + baseLen, ".aot");
 
-  sample.data = (float*)samples_sqr_raw;
-  cvector_push_back(manager->samples, sample);
+  struct stat wasmStat;
+  struct stat aotStat;
+  if (stat(out, &aotStat) != 0) {
+    return false;
+  }
+  if (stat(path, &wasmStat) == 0 && aotStat.st_mtime < wasmStat.st_mtime) {
+    fprintf(stderr, "Ignoring %s, it's older than %s\n", out, path);
+    return false;
+  }
+  return true;
+}
 
-  sample.data = (float*)samples_tri_raw;
-  cvector_push_back(manager->samples, sample);
+// sha256 of a unit file, only read (and hashed) if it's new, or its stat changed since the last time
+static bool file_hash(NullUnitManager* manager, const char* path, uint8_t hash[32]) {
+  struct stat st;
+  if (stat(path, &st) != 0) {
+    return false;
+  }
+#ifdef __APPLE__
+  struct timespec mtime = st.st_mtimespec;
+#else
+  struct timespec mtime = st.st_mtim;
+#endif
+  size_t i = 0;
+  while (i < cvector_size(manager->file_hashes) && strcmp(manager->file_hashes[i].path, path) != 0) {
+    i++;
+  }
+  if (i < cvector_size(manager->file_hashes)) {
+    NullFileHash* known = &manager->file_hashes[i];
+    if (known->dev == st.st_dev && known->ino == st.st_ino && known->size == st.st_size && known->mtime.tv_sec == mtime.tv_sec && known->mtime.tv_nsec == mtime.tv_nsec) {
+      memcpy(hash, known->hash, 32);
+      return true;
+    }
+  }
 
-  sample.data = (float*)samples_saw_raw;
-  cvector_push_back(manager->samples, sample);
+  size_t len;
+  unsigned char* bytes = null_manager_map_file(path, &len, false, NULL);
+  if (bytes == NULL) {
+    return false;
+  }
+  null_sha256(bytes, len, hash);
+  null_manager_unmap_file(bytes, len);
+  if (i == cvector_size(manager->file_hashes)) {
+    NullFileHash added = { .path = strdup(path) };
+    cvector_push_back(manager->file_hashes, added);
+  }
+  NullFileHash* known = &manager->file_hashes[i];
+  known->dev = st.st_dev;
+  known->ino = st.st_ino;
+  known->size = st.st_size;
+  known->mtime = mtime;
+  memcpy(known->hash, hash, 32);
+  return true;
+}
 
-  return manager;
+// .aot for a .wasm: next to it, or in the AOT cache (which gets it compiled for next time, if it's not there)
+static bool unit_aot_path(NullUnitManager* manager, const char* path, char* out, size_t size, bool* cached) {
+  *cached = false;
+  if (unit_aot_sidecar(manager, path, out, size)) {
+    return true;
+  }
+  NullAotCache* cache = unit_aot_cache(manager);
+  if (cache == NULL) {
+    return false;
+  }
+  uint8_t hash[32];
+  if (!file_hash(manager, path, hash)) {
+    return false;
+  }
+  if (null_aot_cache_path(cache, hash, out, size)) {
+    *cached = true;
+    return true;
+  }
+  null_aot_cache_compile(cache, path);
+  return false;
 }
 
-// Clean up
-void null_manager_destroy(NullUnitManager* manager) {
-  if (manager->outstream != NULL){
-    soundio_outstream_destroy(manager->outstream);
+// get the compiled module for a .wasm (or .aot) file, from the cache if its content hasn't changed
+static NullUnitModule* module_get(NullUnitManager* manager, const char* path) {
+  // a file that hasn't changed is only stat'd, so loading it again costs just the instantiate
+  uint8_t hash[32];
+  if (!file_hash(manager, path, hash)) {
+    fprintf(stderr, "Could not read unit: %s\n", path);
+    return NULL;
   }
-  if (device != NULL) {
-    soundio_device_unref(device);
+  for (size_t i = 0; i < cvector_size(manager->modules); i++) {
+    NullUnitModule* module = manager->modules[i];
+    if (strcmp(module->path, path) == 0 && memcmp(module->hash, hash, 32) == 0) {
+      return module;
+    }
   }
-  if (soundio != NULL) {
-    soundio_destroy(soundio);
+
+  // file changed, so unused old versions can go
+  for (size_t i = 0; i < cvector_size(manager->modules);) {
+    NullUnitModule* module = manager->modules[i];
+    if (module->refs == 0 && strcmp(module->path, path) == 0) {
+      module_free(module);
+      cvector_erase(manager->modules, i);
+    } else {
+      i++;
+    }
   }
 
-  // TODO: free all manager->units, manager->samples
-  // TODO: free wasm stuff
-  free(manager);
+  // mapped copy-on-write: WAMR keeps the bytes around (and might patch them), but untouched pages stay shared
+  size_t bytesLen;
+  unsigned char* bytes = null_manager_map_file(path, &bytesLen, true, NULL);
+  if (bytes == NULL || bytesLen > UINT32_MAX) {
+    fprintf(stderr, "Could not read unit: %s\n", path);
+    null_manager_unmap_file(bytes, bytesLen);
+    return NULL;
+  }
+  madvise(bytes, bytesLen, MADV_WILLNEED);
+
+  char error_buf[128];
+  wasm_module_t wasmModule = wasm_runtime_load(bytes, (uint32_t)bytesLen, error_buf, sizeof(error_buf));
+  if (wasmModule == NULL) {
+    fprintf(stderr, "Could not load unit %s: %s\n", path, error_buf);
+    null_manager_unmap_file(bytes, bytesLen);
+    return NULL;
+  }
+
+  NullUnitModule* module = calloc(1, sizeof(NullUnitModule));
+  int32_t importCount = wasm_runtime_get_import_count(wasmModule);
+  for (int32_t i = 0; i < importCount; i++) {
+    wasm_import_t import;
+    wasm_runtime_get_import_type(wasmModule, i, &import);
+    if (import.kind == WASM_IMPORT_EXPORT_KIND_FUNC && strcmp(import.module_name, "env") == 0 && strcmp(import.name, "get_data_ptr") == 0) {
+      module->data_ptr = true;
+    }
+  }
+  module->path = strdup(path);
+  memcpy(module->hash, hash, 32);
+  module->bytes = bytes;
+  module->size = bytesLen;
+  module->module = wasmModule;
+  cvector_push_back(manager->modules, module);
+  return module;
+}
+
+// pick how units are run (before loading any), false if it's not built
+bool null_manager_set_engine(NullUnitManager* manager, NullUnitEngine engine) {
+  RunningMode mode = Mode_Interp;
+  switch (engine) {
+    case NULL_ENGINE_AUTO:
+      // whatever WAMR thinks is best, of what is built
+      manager->engine = engine;
+      return true;
+    case NULL_ENGINE_INTERP:
+      if (NULL_WAMR_FAST_INTERP) {
+        printf("classic interpreter is not built, using fast-interp\n");
+      }
+      break;
+    case NULL_ENGINE_FAST_INTERP:
+      if (!NULL_WAMR_FAST_INTERP) {
+        printf("fast interpreter is not built (cmake -DNULLUNIT_FAST_INTERP=ON), using classic interpreter\n");
+      }
+      break;
+    case NULL_ENGINE_AOT:
+      if (!NULL_WAMR_AOT) {
+        fprintf(stderr, "AOT is not built (cmake -DNULLUNIT_AOT=ON)\n");
+        return false;
+      }
+      break;
+    case NULL_ENGINE_JIT:
+      mode = NULL_WAMR_JIT ? Mode_LLVM_JIT : Mode_Fast_JIT;
+      if (!wasm_runtime_is_running_mode_supported(mode)) {
+        fprintf(stderr, "JIT is not built (cmake -DNULLUNIT_JIT=ON or -DNULLUNIT_FAST_JIT=ON)\n");
+        return false;
+      }
+      break;
+  }
+  if (!wasm_runtime_set_default_running_mode(mode)) {
+    fprintf(stderr, "Could not set wasm running mode\n");
+    return false;
+  }
+  manager->engine = engine;
+  return true;
+}
+
+// engine from its name
+bool null_manager_engine_from_name(const char* name, NullUnitEngine* engine) {
+  const char* names[] = { "auto", "interp", "fast-interp", "aot", "jit" };
+  for (int i = 0; i < 5; i++) {
+    if (strcmp(name, names[i]) == 0) {
+      *engine = (NullUnitEngine)i;
+      return true;
+    }
+  }
+  return false;
+}
+
+// make a unit (not live yet), NULL if it can't be
+static NullUnit* unit_create(NullUnitManager* manager, const char* name, unsigned int newUnitId) {
+  char* path = NULL;
+  for (size_t i = 0; i < cvector_size(manager->available_units); i++) {
+    if (strcmp(manager->available_units[i].name, name) == 0) {
+      path = manager->available_units[i].path;
+      break;
+    }
+  }
+  if (strcmp(name, "osc") == 0) {
+    NullUnit* osc = null_unit_builtin(manager, NULL_UNIT_OSC, "osc", 0, 1);
+    osc->id = newUnitId;
+    builtin_param(osc, "type", NULL_PARAM_I32, (NullUnitParamValue){ .i=0 }, (NullUnitParamValue){ .i=3 }, (NullUnitParamValue){ .i=0 });
+    builtin_param(osc, "note", NULL_PARAM_F32, (NullUnitParamValue){ .f=0.0f }, (NullUnitParamValue){ .f=127.0f }, (NullUnitParamValue){ .f=0.0f });
+    return osc;
+  }
+  if (path == NULL) {
+    fprintf(stderr, "Unit not found: %s\n", name);
+    return NULL;
+  }
+
+  char error_buf[128];
+  NullUnit* unit = calloc(1, sizeof(NullUnit));
+  unit->manager = manager;
+  unit->kind = NULL_UNIT_WASM;
+  unit->id = newUnitId;
+  unit->active = true;
+
+  char aotPath[PATH_MAX];
+  bool cached;
+  if (unit_aot_path(manager, path, aotPath, sizeof(aotPath), &cached)) {
+    unit->module = module_get(manager, aotPath);
+    if (unit->module == NULL && cached) {
+      // cached one is no good (made by another wamrc version?), so make it again
+      unlink(aotPath);
+      null_aot_cache_compile(manager->aot_cache, path);
+    }
+  } else if (manager->engine == NULL_ENGINE_AOT) {
+    fprintf(stderr, "No .aot for %s yet, using interpreter\n", path);
+  }
+  if (unit->module == NULL) {
+    unit->module = module_get(manager, path);
+  }
+  if (unit->module == NULL) {
+    unit_free(unit);
+    return NULL;
+  }
+  unit->module->refs++;
+
+  unit->module_inst = wasm_runtime_instantiate(unit->module->module, NULL_UNIT_STACK_SIZE, 0, error_buf, sizeof(error_buf));
+  if (unit->module_inst == NULL) {
+    fprintf(stderr, "Could not instantiate unit %s: %s\n", name, error_buf);
+    unit_free(unit);
+    return NULL;
+  }
+
+  unit->exec_env = wasm_runtime_create_exec_env(unit->module_inst, NULL_UNIT_STACK_SIZE);
+  if (unit->exec_env == NULL) {
+    fprintf(stderr, "Could not create exec env for unit %s\n", name);
+    unit_free(unit);
+    return NULL;
+  }
+  wasm_runtime_set_user_data(unit->exec_env, unit);
+
+  // samples are mapped in before main(), so it can get_data_ptr() them (if it asks for them at all)
+  if (unit->module->data_ptr) {
+    null_samples_map_unit(manager, unit);
+  }
+
+  // run main(), which sets up unitInfo
+  wasm_function_inst_t fn_start = wasm_runtime_lookup_function(unit->module_inst, "_start");
+  if (fn_start != NULL && !wasm_runtime_call_wasm(unit->exec_env, fn_start, 0, NULL)) {
+    fprintf(stderr, "Could not start unit %s: %s\n", name, wasm_runtime_get_exception(unit->module_inst));
+    unit_free(unit);
+    return NULL;
+  }
+
+  unit->fn_process = wasm_runtime_lookup_function(unit->module_inst, "process");
+  unit->fn_process_block = wasm_runtime_lookup_function(unit->module_inst, "process_block");
+  unit->fn_param_set = wasm_runtime_lookup_function(unit->module_inst, "param_set");
+  unit->fn_param_get = wasm_runtime_lookup_function(unit->module_inst, "param_get");
+  unit->fn_destroy = wasm_runtime_lookup_function(unit->module_inst, "destroy");
+  unit->fn_tail = wasm_runtime_lookup_function(unit->module_inst, "tail");
+  unit->fn_sleeping = wasm_runtime_lookup_function(unit->module_inst, "sleeping");
+  wasm_function_inst_t fn_get_info = wasm_runtime_lookup_function(unit->module_inst, "get_info");
+  if (unit->fn_process == NULL || fn_get_info == NULL) {
+    fprintf(stderr, "Unit %s does not export process/get_info\n", name);
+    unit_free(unit);
+    return NULL;
+  }
+
+  unit->info = unit_read_info(unit, fn_get_info);
+  if (unit->info == NULL) {
+    fprintf(stderr, "Could not get info for unit %s\n", name);
+    unit_free(unit);
+    return NULL;
+  }
+
+  // in/out blocks (and param value for param_set) live in unit memory, so the unit can work on them directly
+  uint32_t blockSize = manager->block * NULL_MAX_CHANNELS * sizeof(float);
+  unit->block_in = wasm_runtime_module_malloc(unit->module_inst, (blockSize * 2) + sizeof(NullUnitParamValue), NULL);
+  if (unit->block_in == 0) {
+    fprintf(stderr, "Could not allocate block buffers for unit %s\n", name);
+    unit_free(unit);
+    return NULL;
+  }
+  unit->block_out = unit->block_in + blockSize;
+  unit->param_value = unit->block_out + blockSize;
+  memset(null_unit_block_in(unit), 0, blockSize * 2);
+  unit->in_app = unit->block_in;
+
+  // output goes to the bus, and (one) input is read from it in place, if it can be mapped into unit memory
+  unit->bus_slot = null_bus_slot_alloc(manager->bus);
+  if (!null_bus_map_unit(manager->bus, unit)) {
+    null_bus_slot_free(manager->bus, unit->bus_slot);
+    unit->bus_slot = 0;
+  }
+
+  // audio thread's copy of param values (ramps start from these)
+  unit->param_count = cvector_size(unit->info->params);
+  unit->params = calloc(unit->param_count + 1, sizeof(NullUnitParamValue));
+  for (unsigned int i = 0; i < unit->param_count; i++) {
+    unit->params[i] = unit->info->params[i]->value;
+  }
+
+  return unit;
+}
+
+// make a unit (not live yet, so it can be set up on any thread), NULL if it can't be
+NullUnit* null_unit_create(NullUnitManager* manager, const char* name, unsigned int id) {
+  pthread_mutex_lock(&manager->unit_lock);
+  NullUnit* unit = unit_create(manager, name, id);
+  pthread_mutex_unlock(&manager->unit_lock);
+  return unit;
+}
+
+// free a unit that isn't in any plan
+void null_unit_free(NullUnit* unit) {
+  NullUnitManager* manager = unit->manager;
+  pthread_mutex_lock(&manager->unit_lock);
+  unit_free(unit);
+  pthread_mutex_unlock(&manager->unit_lock);
 }
 
 // load a unit
 unsigned int null_manager_load(NullUnitManager* manager, const char* name) {
   unsigned int newUnitId = cvector_size(manager->units);
-  // TODO: do wasm stuff
+  NullUnit* unit = null_unit_create(manager, name, newUnitId);
+  if (unit == NULL) {
+    return NULL_UNIT_INVALID;
+  }
+  cvector_push_back(manager->units, unit);
   return newUnitId;
 }
 
+// unload a unit (that is there)
+static void unit_unload(NullUnitManager* manager, unsigned int unitId) {
+
+  for (size_t i = 0; i < cvector_size(manager->connections);) {
+    if (manager->connections[i].source == unitId || manager->connections[i].destination == unitId) {
+      cvector_erase(manager->connections, i);
+    } else {
+      i++;
+    }
+  }
+  NullCommand command = {
+    .type = NULL_COMMAND_UNLOAD,
+    .unit = manager->units[unitId]
+  };
+  null_manager_send(manager, &command);
+  null_manager_compile(manager);
+
+  // audio thread might still be rendering it, so free it once it's on the new plan
+  // (in a batch, that's the one compiled when the batch ends)
+  NullUnitGarbage garbage = {
+    .unit = manager->units[unitId],
+    .serial = manager->plan_serial_next + (manager->batch_depth > 0 ? 1 : 0)
+  };
+  cvector_push_back(manager->garbage, garbage);
+  manager->units[unitId] = NULL;
+}
+
 // unload a unit
 void null_manager_unload(NullUnitManager* manager, unsigned int unitId) {
-  // TODO: do wasm stuff
+  // unit 0 is audioOut, and ids are not re-used, so the slot just becomes NULL
+  if (unitId == 0 || unitId >= cvector_size(manager->units) || manager->units[unitId] == NULL) {
+    return;
+  }
+  NullUnit* unit = manager->units[unitId];
+  if (unit->voice != NULL) {
+    fprintf(stderr, "Unit %u is a voice, unload its voice group\n", unitId);
+    return;
+  }
+
+  // a voice group goes with all of its voices
+  NullVoiceGroup* group = unit->group;
+  null_manager_batch_begin(manager);
+  for (unsigned int v = 0; group != NULL && v < group->voice_count; v++) {
+    for (unsigned int p = 0; p < group->length; p++) {
+      if (group->voices[v].units[p] != NULL) {
+        unit_unload(manager, group->voices[v].units[p]->id);
+      }
+    }
+  }
+  unit_unload(manager, unitId);
+  null_manager_batch_end(manager);
+}
+
+// find a connection, or -1
+static int find_connection(NullUnitManager* manager, unsigned int unitSourceId, unsigned int unitSourcePort, unsigned int unitDestinationId, unsigned int unitDestinationPort) {
+  for (size_t i = 0; i < cvector_size(manager->connections); i++) {
+    NullUnitConnection* c = &manager->connections[i];
+    if (c->source == unitSourceId && c->sourcePort == unitSourcePort && c->destination == unitDestinationId && c->destinationPort == unitDestinationPort) {
+      return i;
+    }
+  }
+  return -1;
 }
 
 // connect a unit to another
 void null_manager_connect(NullUnitManager* manager, unsigned int unitSourceId, unsigned int unitSourcePort, unsigned int unitDestinationId, unsigned int unitDestinationPort) {
-  // TODO: do audio stuff
+  unsigned int unitCount = cvector_size(manager->units);
+  if (unitSourceId == 0 || unitSourceId >= unitCount || unitDestinationId >= unitCount || manager->units[unitSourceId] == NULL || manager->units[unitDestinationId] == NULL) {
+    fprintf(stderr, "Invalid connection: %u -> %u\n", unitSourceId, unitDestinationId);
+    return;
+  }
+  if (find_connection(manager, unitSourceId, unitSourcePort, unitDestinationId, unitDestinationPort) != -1) {
+    return;
+  }
+
+  NullUnitConnection connection = {
+    .source = unitSourceId,
+    .sourcePort = unitSourcePort,
+    .destination = unitDestinationId,
+    .destinationPort = unitDestinationPort
+  };
+  cvector_push_back(manager->connections, connection);
+  null_manager_compile(manager);
 }
 
 // disconnect
 void null_manager_disconnect(NullUnitManager* manager, unsigned int unitSourceId, unsigned int unitSourcePort, unsigned int unitDestinationId, unsigned int unitDestinationPort) {
-  // TODO: do audio stuff
+  int i = find_connection(manager, unitSourceId, unitSourcePort, unitDestinationId, unitDestinationPort);
+  if (i == -1) {
+    return;
+  }
+  cvector_erase(manager->connections, i);
+  null_manager_compile(manager);
 }
 
 // set a param of a unit
 void null_manager_set_param(NullUnitManager* manager, unsigned int unitSourceId, unsigned int paramId, NullUnitParamValue value, float timefromNowInSeconds) {
-  // TODO: do wasm stuff
+  NullUnitnInfo* info = null_manager_get_info(manager, unitSourceId);
+  if (info == NULL || paramId >= cvector_size(info->params)) {
+    return;
+  }
+
+  // stamp with an absolute frame, so audio thread can apply it on the exact sample
+  uint64_t now = atomic_load_explicit(&manager->frames, memory_order_relaxed);
+  uint64_t frame = now;
+  if (timefromNowInSeconds > 0.0f) {
+    frame += (uint64_t)llroundf(timefromNowInSeconds * manager->sample_rate);
+  }
+
+  // info is the control thread's copy, the unit itself is only touched on the audio thread.
+  // a change for later goes in info once it's happened
+  if (frame == now) {
+    info->params[paramId]->value = value;
+  } else {
+    NullParamPending pending = {
+      .unit = manager->units[unitSourceId],
+      .param = paramId,
+      .value = value,
+      .frame = frame
+    };
+    size_t at = cvector_size(manager->pending_params);
+    while (at > 0 && manager->pending_params[at - 1].frame > frame) {
+      at--;
+    }
+    cvector_insert(manager->pending_params, at, pending);
+  }
+
+  NullCommand command = {
+    .type = NULL_COMMAND_SET_PARAM,
+    .unit = manager->units[unitSourceId],
+    .param = paramId,
+    .value = value,
+    .frame = frame
+  };
+  null_manager_send(manager, &command);
+}
+
+// ramp a param of a unit from where it is now to target, over seconds
+void null_manager_ramp_param(NullUnitManager* manager, unsigned int unitSourceId, unsigned int paramId, float target, float seconds, NullRampCurve curve) {
+  NullUnitnInfo* info = null_manager_get_info(manager, unitSourceId);
+  if (info == NULL || paramId >= cvector_size(info->params)) {
+    return;
+  }
+
+  NullUnitParamValue value = { .f = target };
+  if (info->params[paramId]->type != NULL_PARAM_F32) {
+    value.i = (int32_t)lroundf(target);
+  }
+  if (seconds <= 0.0f) {
+    null_manager_set_param(manager, unitSourceId, paramId, value, 0.0f);
+    return;
+  }
+
+  // info gets where it's headed, audio thread works out where it is along the way
+  info->params[paramId]->value = value;
+
+  NullCommand command = {
+    .type = NULL_COMMAND_RAMP,
+    .unit = manager->units[unitSourceId],
+    .param = paramId,
+    .value = { .f = target },
+    .frame = atomic_load_explicit(&manager->frames, memory_order_relaxed),
+    .duration = (uint32_t)llroundf(seconds * manager->sample_rate),
+    .curve = curve
+  };
+  null_manager_send(manager, &command);
 }
 
 // get a param of a unit
 NullUnitParamValue* null_manager_get_param(NullUnitManager* manager, unsigned int unitSourceId, unsigned int paramId) {
-  // TODO: do wasm stuff
-  return NULL;
+  NullUnitnInfo* info = null_manager_get_info(manager, unitSourceId);
+  if (info == NULL || paramId >= cvector_size(info->params)) {
+    return NULL;
+  }
+  return &info->params[paramId]->value;
 }
 
-// get info about a loaded unit
+// get info about a loaded unit (params as the audio thread has them, as of the last block)
 NullUnitnInfo* null_manager_get_info(NullUnitManager* manager, unsigned int unitSourceId) {
-  // TODO: do wasm stuff
-  return NULL;
+  if (unitSourceId >= cvector_size(manager->units) || manager->units[unitSourceId] == NULL) {
+    return NULL;
+  }
+  pending_params_apply(manager);
+  return manager->units[unitSourceId]->info;
 }
 
 // load list of wasm files in a dir into manager->available_units
@@ -237,6 +1401,12 @@ void null_manager_get_units(NullUnitManager* manager, const char* dirname) {
             *dot = '\0';
         }
 
+        // get it AOT compiled in the background, if it's not already
+        char aotPath[PATH_MAX];
+        if (unit_aot_cache(manager) != NULL && !unit_aot_sidecar(manager, full_path, aotPath, sizeof(aotPath))) {
+            null_aot_cache_compile(manager->aot_cache, full_path);
+        }
+
         // Create new NullUnitAvailable structure
         NullUnitAvailable unit = {
             .name = name,
@@ -291,3 +1461,75 @@ unsigned char* null_manager_read_file(char* filename, int* bytesRead) {
 
     return buffer;
 }
+
+// map a whole file (MAP_PRIVATE, so pages come from the page cache when they are first touched), NULL if it can't be
+// writable pages are copy-on-write, fd (if not NULL) gets the open file, so it can be mapped again
+unsigned char* null_manager_map_file(const char* filename, size_t* size, bool writable, int* fd) {
+  *size = 0;
+  int file = open(filename, O_RDONLY | O_CLOEXEC);
+  if (file < 0) {
+    return NULL;
+  }
+  struct stat st;
+  if (fstat(file, &st) != 0 || st.st_size <= 0) {
+    close(file);
+    return NULL;
+  }
+  void* data = mmap(NULL, st.st_size, PROT_READ | (writable ? PROT_WRITE : 0), MAP_PRIVATE, file, 0);
+  if (data == MAP_FAILED) {
+    close(file);
+    return NULL;
+  }
+  *size = st.st_size;
+  if (fd != NULL) {
+    *fd = file;
+  } else {
+    close(file);
+  }
+  return data;
+}
+
+// unmap a file from null_manager_map_file
+void null_manager_unmap_file(void* data, size_t size) {
+  if (data != NULL) {
+    munmap(data, size);
+  }
+}
+
+// mkdir -p
+static bool make_dirs(char* path) {
+  for (char* p = path + 1; *p; p++) {
+    if (*p == '/') {
+      *p = '\0';
+      int err = mkdir(path, 0755);
+      *p = '/';
+      if (err != 0 && errno != EEXIST) {
+        return false;
+      }
+    }
+  }
+  return mkdir(path, 0755) == 0 || errno == EEXIST;
+}
+
+// dir of an on-disk cache (made if it's not there), false if there is none
+// $env overrides it ("off" to not use a cache), otherwise it's nullunits/name in $XDG_CACHE_HOME (or ~/.cache)
+bool null_cache_dir(const char* env, const char* name, char* out, size_t size) {
+  const char* dir = getenv(env);
+  if (dir != NULL && strcmp(dir, "off") == 0) {
+    return false;
+  }
+  if (dir != NULL && dir[0] != '\0') {
+    snprintf(out, size, "%s", dir);
+  } else if (getenv("XDG_CACHE_HOME") != NULL && getenv("XDG_CACHE_HOME")[0] != '\0') {
+    snprintf(out, size, "%s/nullunits/%s", getenv("XDG_CACHE_HOME"), name);
+  } else if (getenv("HOME") != NULL) {
+    snprintf(out, size, "%s/.cache/nullunits/%s", getenv("HOME"), name);
+  } else {
+    return false;
+  }
+  if (!make_dirs(out)) {
+    fprintf(stderr, "Could not make cache dir %s: %s\n", out, strerror(errno));
+    return false;
+  }
+  return true;
+}
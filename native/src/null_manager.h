@@ -9,6 +9,10 @@
 #include <stdlib.h>
 #include <libgen.h>
 #include <math.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/stat.h>
 
 #define CVECTOR_LOGARITHMIC_GROWTH
 #include "cvector.h"
@@ -16,9 +20,52 @@
 #include <soundio/soundio.h>
 #include "wasm_export.h"
 
+// which WAMR tiers were built (set by cmake/Findwamr.cmake)
+#ifndef NULL_WAMR_FAST_INTERP
+#define NULL_WAMR_FAST_INTERP 0
+#endif
+#ifndef NULL_WAMR_AOT
+#define NULL_WAMR_AOT 0
+#endif
+#ifndef NULL_WAMR_JIT
+#define NULL_WAMR_JIT 0
+#endif
+#ifndef NULL_WAMR_FAST_JIT
+#define NULL_WAMR_FAST_JIT 0
+#endif
+
+// unit memory is reserved up-front, and doesn't move when it grows (WAMR's hardware bounds checks, set by cmake/Findwamr.cmake)
+#ifndef NULL_WAMR_HW_BOUND_CHECK
+#define NULL_WAMR_HW_BOUND_CHECK 0
+#endif
+
+// FLAC decoding (set by cmake/Finddrflac.cmake)
+#ifndef NULL_FLAC
+#define NULL_FLAC 0
+#endif
+
+// defaults, if nothing else is asked for (see NullAudioConfig)
 #define SAMPLE_RATE 48000
 #define FRAMES_PER_BUFFER 256
 
+// most frames units can be run with at a time
+#define NULL_MAX_BLOCK 4096
+
+// max channels a unit is run with (interleaved in block buffers)
+#define NULL_MAX_CHANNELS 2
+
+// how many unit outputs the shared audio bus has room for
+#define NULL_BUS_SLOTS 1024
+
+// slots of the bus a unit has mapped at once: its own, and ones it reads in place (while plans change)
+#define NULL_BUS_WINDOWS 4
+
+// wasm stack size for each unit
+#define NULL_UNIT_STACK_SIZE (64 * 1024)
+
+// returned from null_manager_load, when it fails
+#define NULL_UNIT_INVALID ((unsigned int)-1)
+
 // these are the valid types for params
 typedef enum {
   NULL_PARAM_BOOL,  // stored as i32
@@ -49,16 +96,289 @@ typedef struct {
   cvector_vector_type(NullUnitParamInfo*) params;
 } NullUnitnInfo;
 
+struct NullUnitManager;
+
+// how many scheduled param-changes can be waiting (for all units)
+#define NULL_EVENT_POOL_SIZE 4096
+
+// how many param ramps can be running (for all units)
+#define NULL_RAMP_POOL_SIZE 1024
+
+// while a param is ramping, units get a new value every this many frames
+#define NULL_RAMP_QUANTUM 32
+
+// shape of a param ramp
+typedef enum {
+  NULL_RAMP_LINEAR,
+  NULL_RAMP_EXPONENTIAL // linear if start/target are not both non-zero with the same sign
+} NullRampCurve;
+
+// a param that is moving towards a target, on the audio thread
+typedef struct NullUnitRamp {
+  unsigned int param;
+  float from;
+  float to;
+  uint64_t start; // frame
+  uint64_t end; // frame
+  NullRampCurve curve;
+  struct NullUnitRamp* next;
+} NullUnitRamp;
+
+// a param-change, scheduled for an exact sample frame
+typedef struct NullUnitEvent {
+  uint64_t frame;
+  unsigned int param;
+  NullUnitParamValue value;
+  struct NullUnitEvent* next;
+} NullUnitEvent;
+
+// what is behind a loaded unit
+typedef enum {
+  NULL_UNIT_WASM,
+  NULL_UNIT_OUT, // built-in audio-out (unit 0)
+  NULL_UNIT_OSC, // built-in wavetable oscillator
+  NULL_UNIT_VOICES // built-in mix of a voice group's voices
+} NullUnitKind;
+
+// how units are run
+typedef enum {
+  NULL_ENGINE_AUTO, // .aot next to the .wasm if there is one (and AOT is built), otherwise interpreter
+  NULL_ENGINE_INTERP, // classic interpreter
+  NULL_ENGINE_FAST_INTERP,
+  NULL_ENGINE_AOT, // .aot made by wamrc, next to the .wasm
+  NULL_ENGINE_JIT // LLVM JIT (or fast JIT, if that's what is built)
+} NullUnitEngine;
+
+// a compiled .wasm, shared by every unit loaded from it
+// keyed by path and content hash, so it's parsed/validated/loaded once, and only instantiated per unit
+typedef struct {
+  char* path;
+  uint8_t hash[32]; // sha256 of bytes
+  unsigned char* bytes; // mapped file, wasm_runtime_load needs it kept around
+  size_t size;
+  wasm_module_t module;
+  unsigned int refs; // units using it, it stays cached at 0 until the file changes
+  bool data_ptr; // it imports get_data_ptr, so its units get samples mapped into their memory
+} NullUnitModule;
+
+// sha256 of a unit file, kept with what stat said about it, so it's only read again once the file changes
+typedef struct {
+  char* path;
+  dev_t dev;
+  ino_t ino;
+  off_t size;
+  struct timespec mtime;
+  uint8_t hash[32];
+} NullFileHash;
+
+// a voice of a voice group, and the group (see null_voices.c)
+typedef struct NullVoice NullVoice;
+typedef struct NullVoiceGroup NullVoiceGroup;
+
+// stats keep a histogram of ns per block, in log2 buckets (so up to ~2s)
+#define NULL_STATS_BUCKETS 32
+
+// DSP time of a unit (or a whole render), written by whichever render thread runs it, read by anyone (see null_stats.c)
+typedef struct {
+  _Atomic uint64_t blocks;
+  _Atomic uint64_t frames;
+  _Atomic uint64_t ns;
+  _Atomic uint64_t worst_ns;
+  _Atomic uint32_t worst_load; // of a block's time, in millionths
+  _Atomic uint32_t histogram[NULL_STATS_BUCKETS];
+} NullStats;
+
+// what stats add up to, when they are read
+typedef struct {
+  uint64_t blocks;
+  double mean_ns; // per block
+  double load; // % of realtime
+  uint64_t worst_ns;
+  double worst_load; // % of a block's time
+  uint32_t histogram[NULL_STATS_BUCKETS];
+} NullStatsReport;
+
 // this is a single loaded unit
 typedef struct {
-    wasm_module_t* module;
-    wasm_module_inst_t* module_inst;
+    struct NullUnitManager* manager;
+    NullUnitKind kind;
+    unsigned int id;
+    NullUnitModule* module; // shared, from the module cache
+    wasm_module_inst_t module_inst;
+    wasm_exec_env_t exec_env;
+    wasm_function_inst_t fn_process;
+    wasm_function_inst_t fn_process_block; // optional, NULL if the unit doesn't export it
+    wasm_function_inst_t fn_param_set;
+    wasm_function_inst_t fn_param_get;
+    wasm_function_inst_t fn_destroy;
+    wasm_function_inst_t fn_tail; // optional: how long output goes on after input is silent
+    wasm_function_inst_t fn_sleeping; // optional: output is silent till a param changes
+    uint32_t block_in; // app-offset of interleaved input block (in unit memory)
+    uint32_t block_out; // app-offset of interleaved output block (in unit memory)
+    uint32_t param_value; // app-offset of NullUnitParamValue that is passed to param_set
+    int bus_slot; // slot of the shared bus this unit's output goes to, 0 if it has none
+    uint32_t bus_view; // app-offset of this unit's view of the bus, in unit memory (0 if it's not mapped)
+    uint8_t* bus_native; // where bus_view was mapped, to notice if unit memory moves
+    int bus_windows[NULL_BUS_WINDOWS]; // slot mapped into each window of the view (0 is its own), -1 for none
+    unsigned int bus_window_refs[NULL_BUS_WINDOWS]; // plans that read from each window
+    uint32_t* sample_apps; // app-offset of each sample mapped into unit memory, by id (0 if it's not)
+    unsigned int sample_app_count;
+    uint32_t in_app; // audio thread: app-offset of this block's input (in the bus view, or block_in)
+    const float* in_host; // audio thread: same, for built-in units
+    NullUnitParamValue* params; // audio thread: current param values
+    unsigned int param_count;
+    NullUnitEvent* events; // audio thread: scheduled param-changes, in frame order
+    NullUnitRamp* ramps; // audio thread: params that are ramping
+    NullUnitEvent* spent_events; // audio thread: done with, go back to the pool after the block
+    NullUnitRamp* spent_ramps;
+    uint8_t position; // sample counter for per-sample process()
+    float* host_block; // in/out blocks for built-in units (they have no unit memory), out is only used without a bus
+    float phase; // built-in osc phase (0-1)
     NullUnitnInfo* info;
-    struct SoundIoRingBuffer* input_buffer;
-    struct SoundIoRingBuffer* output_buffer;
     bool active;
+    NullVoice* voice; // voice this unit is part of (NULL if it's not), it isn't run while that is idle
+    NullVoiceGroup* group; // voice group this (NULL_UNIT_VOICES) unit mixes
+    bool cleared; // audio thread: output was cleared, since it went idle
+    bool asleep; // audio thread: not run (output is silence) till input (or a param change) wakes it
+    bool demanded; // audio thread: something that is awake reads its output, this block
+    uint64_t silent_frames; // audio thread: how long input has been silent
+    uint32_t tail_frames; // audio thread: how long output goes on after that (asked when input goes silent)
+    NullStats stats; // DSP time of this unit
 } NullUnit;
 
+// a voice is quiet (after note-off) once its peak stays under this for NULL_VOICE_QUIET_BLOCKS, then it's idle
+#define NULL_VOICE_QUIET 0.0001f
+#define NULL_VOICE_QUIET_BLOCKS 4
+
+// which voice a voice group takes for a note, when they are all busy (ones ringing out after note-off go first)
+typedef enum {
+  NULL_STEAL_OLDEST,
+  NULL_STEAL_QUIETEST
+} NullVoiceSteal;
+
+// what a voice's param gets from a note, found by param name ("note", "trigger" or "gate", "velocity")
+typedef enum {
+  NULL_VOICE_NOTE, // note number
+  NULL_VOICE_GATE, // 1 while the note is held
+  NULL_VOICE_VELOCITY // velocity (0-1), scaled to the param's range
+} NullVoiceRole;
+
+typedef struct {
+  unsigned int position; // which unit in the voice
+  unsigned int param;
+  NullVoiceRole role;
+} NullVoiceBinding;
+
+// one of a voice group's copies of its units, only rendered while it has a note (or is ringing out)
+struct NullVoice {
+  NullUnit** units; // in a chain, the last one's output is the voice's
+  int note; // audio thread: -1 if it's free
+  bool gate; // audio thread: note is held
+  bool sounding; // audio thread: it's rendered
+  uint64_t started; // audio thread: frame its note started on
+  float level; // audio thread: peak of its last block
+  unsigned int quiet; // audio thread: blocks it's been quiet since note-off
+};
+
+// N voices, made up-front, that notes are given to (and taken from) on the audio thread
+struct NullVoiceGroup {
+  NullVoice* voices;
+  unsigned int voice_count;
+  unsigned int length; // units in each voice
+  NullVoiceBinding* bindings;
+  unsigned int binding_count;
+  bool gated; // something in a voice has a gate, so voices ring out after note-off (otherwise they stop)
+  NullVoiceSteal steal;
+};
+
+// a block is silent if no sample is louder than this (-100dB)
+#define NULL_SILENCE 0.00001f
+
+// a connection from the output of one unit to the input of another
+typedef struct {
+  unsigned int source;
+  unsigned int sourcePort;
+  unsigned int destination;
+  unsigned int destinationPort;
+} NullUnitConnection;
+
+// a single step in a plan: point unit at its input (or mix inputs into unit's block_in), then run it
+typedef struct {
+  NullUnit* unit;
+  NullUnit** inputs;
+  unsigned int input_count;
+  int window; // window of unit's view of the bus its input is read from in place, -1 to copy it
+  unsigned int* dependents; // nodes (by index) that wait for this one
+  unsigned int dependent_count;
+  unsigned int dependency_count; // how many nodes this one waits for
+  atomic_uint pending; // workers: dependencies that are not done yet, this block
+} NullUnitPlanNode;
+
+// flat execution plan, compiled from the connections whenever the graph changes
+// the audio thread walks this in order, or spreads it over the workers by dependencies
+typedef struct {
+  unsigned int serial;
+  NullUnitPlanNode* nodes; // topologically sorted
+  unsigned int node_count;
+  NullUnit** outputs; // units connected to audioOut (unit 0)
+  unsigned int output_count;
+  NullUnit** inputs; // storage for all node inputs
+  unsigned int* dependents; // storage for all node dependents
+  bool feedback; // some node reads one that runs after it (so what needs to run can't be worked out backwards)
+} NullUnitPlan;
+
+// a unit that was unloaded, but might still be in the plan the audio thread is rendering
+typedef struct {
+  NullUnit* unit;
+  unsigned int serial; // free it once audio thread is on this plan (or newer)
+} NullUnitGarbage;
+
+// a param change that was scheduled for later, so it's only shown in the unit's info once it's happened
+typedef struct {
+  NullUnit* unit;
+  unsigned int param;
+  NullUnitParamValue value;
+  uint64_t frame; // audio thread sets it on this frame
+} NullParamPending;
+
+#include "null_ring.h"
+
+
+// shared audio bus, that units read their input from in place (see null_bus.c)
+typedef struct NullBus NullBus;
+
+// most of a unit's memory that samples are mapped into (the rest it gets with get_data_floats)
+#define NULL_SAMPLE_VIEW_MAX ((size_t)1 << 30)
+
+// how much of a sample file is read in up-front (and kept in RAM, if it's streamed), so it starts without waiting on the disk
+#define NULL_SAMPLE_HEAD (128 * 1024)
+
+// voices streaming sample files from disk, and the thread that reads ahead of them (see null_stream.c)
+typedef struct NullStreams NullStreams;
+
+// most nodes a plan can have, and still be spread over workers
+#define NULL_WORKER_DEQUE_SIZE 4096
+
+// on-disk cache of units compiled with wamrc (see null_aot.c)
+typedef struct NullAotCache NullAotCache;
+
+// a patch: units and connections, loaded (and compiled) in the background, to switch to all at once (see null_patch.c)
+typedef struct NullPatch NullPatch;
+
+// sets up a patch on the preload thread, with null_patch_load/connect/set_param (data is its own, to free)
+typedef void (*NullPatchBuild)(NullPatch* patch, void* data);
+
+// pool of threads that render a plan together with the audio thread (see null_workers.c)
+typedef struct NullWorkers NullWorkers;
+
+// how render threads are set up for realtime work (see null_realtime.c)
+typedef struct {
+  bool ftz; // flush denormals to zero
+  bool lock_memory; // mlockall, once everything is loaded
+  int priority; // SCHED_FIFO priority (1-99), 0 to leave it
+  cvector_vector_type(int) cpus; // cores render threads are pinned to (audio thread first), NULL for workers on a core each
+} NullRealtime;
+
 // this is info about an available unit
 typedef struct {
   char* name;
@@ -67,22 +387,114 @@ typedef struct {
 
 // this is a loaded sample
 typedef struct {
-  float* data;
-  int len;
+  float* data; // host view
+  int len; // bytes
+  unsigned int channels; // interleaved
+  int fd; // file or sample bank it's in (mapped into units from there), -1 if it's only host memory
+  size_t offset; // where it is in fd
+  float* head; // start of a streamed sample file, kept in RAM (NULL if it's not streamed)
+  int head_len; // bytes
 } NullUnitSample;
 
-// this represents a complete manager instance
+// recent xruns the control thread keeps (it gets them through a ring of this size from the audio thread)
+#define NULL_XRUN_RECENT 64
+
+// an underflow, and what the audio thread was up to when it happened
+typedef struct {
+  uint64_t frame; // manager->frames when it happened
+  uint64_t render_ns; // how long the last block took to render
+  unsigned int render_frames; // how many frames that block was
+  unsigned int nodes; // units in the plan
+  NullCommandType command; // last command applied
+  unsigned int command_unit; // unit that was for (NULL_UNIT_INVALID if it wasn't for one)
+  uint64_t command_frame; // when it was applied
+} NullXrun;
+
+// how to set up audio, 0 (or NULL) for the default
 typedef struct {
+  unsigned int sample_rate; // asked for, the device might have to use the nearest one it has (default SAMPLE_RATE)
+  unsigned int block; // frames units are always run with, the render quantum (default: FRAMES_PER_BUFFER, or less if latency is lower)
+  double latency; // seconds of buffer to ask the device for (default: whatever the backend picks)
+  const char* backend; // libsoundio backend, like jack, pulseaudio, alsa, coreaudio, wasapi (default: first that works)
+  const char* device; // output device id, name, or index (default: system default)
+} NullAudioConfig;
+
+// this represents a complete manager instance
+typedef struct NullUnitManager {
     struct SoundIo* soundio;
     struct SoundIoDevice* device;
     struct SoundIoOutStream* outstream;
+    struct SoundIoRingBuffer* fifo; // audio thread: rendered frames (for the device's channels) it hasn't taken yet
     cvector_vector_type(NullUnitSample) samples;
     cvector_vector_type(NullUnit*) units; // these are loaded
     cvector_vector_type(NullUnitAvailable) available_units; // these are found via paths or whatever
+    cvector_vector_type(NullUnitConnection) connections;
+    cvector_vector_type(NullUnitGarbage) garbage;
+    cvector_vector_type(NullParamPending) pending_params; // control thread: scheduled param changes, oldest frame first
+    cvector_vector_type(NullUnitModule*) modules; // module cache
+    cvector_vector_type(NullFileHash) file_hashes; // of .wasm files, for the module and AOT caches
+    unsigned int plan_serial_next; // serial of last compiled plan
+    unsigned int plan_serial; // serial of the last plan audio thread picked up
+    NullUnitPlan* plan; // audio thread: plan that is being rendered
+    NullUnitPlan* fade_plan; // audio thread: plan that is crossfading out (NULL if there isn't one)
+    NullCommand fade_done; // audio thread: completion for when the crossfade is done
+    uint64_t fade_start; // audio thread: frame the crossfade started on
+    uint32_t fade_frames;
+    unsigned int batch_depth; // > 0 while a batch is open (see null_manager_batch_begin)
+    bool batch_compile; // something in the batch changed the graph
+    cvector_vector_type(NullCommand) batch; // commands held till the batch ends
+    NullRing* commands; // control -> audio
+    NullRing* completions; // audio -> control
+    unsigned int sample_rate;
+    unsigned int channels; // channels units are run with
+    unsigned int block; // frames units are run with at a time (their in/out blocks hold this many)
+    _Atomic uint64_t frames; // frames rendered so far
+    NullUnitEvent* event_pool; // preallocated events
+    NullUnitEvent* event_free; // audio thread: unused events from pool
+    NullUnitRamp* ramp_pool; // preallocated ramps
+    NullUnitRamp* ramp_free; // audio thread: unused ramps from pool
+    _Atomic(NullUnitEvent*) event_returned; // control -> audio: events freed units still had, taken back when the pool runs dry
+    _Atomic(NullUnitRamp*) ramp_returned;
+    NullBus* bus; // NULL if units copy their input
+    int sample_fd; // bank for in-memory samples (see null_samples.c), -1 if there isn't one
+    bool sample_fd_tried;
+    size_t sample_bank_size;
+    NullStreams* streams; // NULL until a sample file is big enough to stream
+    _Atomic(NullWorkers*) workers; // NULL to render everything on the audio thread
+    bool offline; // no device, whoever calls null_manager_render is the audio thread
+    NullUnitEngine engine;
+    NullAotCache* aot_cache; // NULL if there is no AOT (or it's not set up yet)
+    bool aot_cache_tried;
+    pthread_mutex_t unit_lock; // units can be made (and freed) on the preload thread too
+    NullRealtime realtime;
+    NullStats stats; // DSP time of whole blocks (every unit, and applying commands)
+    _Atomic uint64_t last_render_ns; // audio thread: last block, for xrun reports
+    atomic_uint last_render_frames;
+    atomic_uint last_render_nodes;
+    atomic_int last_command; // audio thread: last command applied (type, unit id, frame), for xrun reports
+    atomic_uint last_command_unit;
+    _Atomic uint64_t last_command_frame;
+    _Atomic uint64_t xrun_count; // underflows so far
+    NullXrun xrun_ring[NULL_XRUN_RECENT]; // audio -> control
+    _Alignas(64) atomic_uint xrun_head;
+    _Alignas(64) atomic_uint xrun_tail;
+    NullXrun xrun_recent[NULL_XRUN_RECENT]; // control thread: last ones, oldest first from xrun_recent_next
+    unsigned int xrun_recent_count;
+    unsigned int xrun_recent_next;
+    atomic_uint realtime_serial; // bumped when realtime changes, so render threads set themselves up again
 } NullUnitManager;
 
-// Initialize the audio system and manager
-NullUnitManager* null_manager_create(void);
+// Initialize the audio system and manager (config can be NULL, for defaults)
+NullUnitManager* null_manager_create(const NullAudioConfig* config);
+
+// Initialize the manager, without an audio device (render it yourself, with null_manager_render, up to block frames at a time)
+NullUnitManager* null_manager_create_offline(unsigned int sampleRate, unsigned int channels, unsigned int block);
+
+// pick how units are run (before loading any), false if it's not built
+bool null_manager_set_engine(NullUnitManager* manager, NullUnitEngine engine);
+
+// engine from its name (interp, fast-interp, aot, jit, auto), false if there isn't one
+bool null_manager_engine_from_name(const char* name, NullUnitEngine* engine);
 
 // Clean up
 void null_manager_destroy(NullUnitManager* manager);
@@ -90,6 +502,15 @@ void null_manager_destroy(NullUnitManager* manager);
 // load a unit
 unsigned int null_manager_load(NullUnitManager* manager, const char* name);
 
+// make a unit (not live yet, so it can be set up on any thread), NULL if it can't be
+NullUnit* null_unit_create(NullUnitManager* manager, const char* name, unsigned int id);
+
+// free a unit that isn't in any plan
+void null_unit_free(NullUnit* unit);
+
+// make a built-in (host-side) unit (not live yet)
+NullUnit* null_unit_builtin(NullUnitManager* manager, NullUnitKind kind, const char* name, uint8_t channelsIn, uint8_t channelsOut);
+
 // unload a unit
 void null_manager_unload(NullUnitManager* manager, unsigned int unitId);
 
@@ -102,6 +523,19 @@ void null_manager_disconnect(NullUnitManager* manager, unsigned int unitSourceId
 // set a param of a unit
 void null_manager_set_param(NullUnitManager* manager, unsigned int unitSourceId, unsigned int paramId, NullUnitParamValue value, float timefromNowInSeconds);
 
+// move a param of a unit to target over seconds, interpolated by the engine
+void null_manager_ramp_param(NullUnitManager* manager, unsigned int unitSourceId, unsigned int paramId, float target, float seconds, NullRampCurve curve);
+
+// make a voice group: count voices, each a chain of units (names, each feeding the next), all loaded now
+// returns the group's id, a unit that outputs the mix of its voices (connect it like any other), or NULL_UNIT_INVALID
+unsigned int null_manager_voices(NullUnitManager* manager, const char** names, unsigned int nameCount, unsigned int count, NullVoiceSteal steal);
+
+// start a note (velocity 0-1) on a free (or stolen) voice of a group, or stop it (velocity 0)
+void null_manager_note(NullUnitManager* manager, unsigned int groupId, unsigned int note, float velocity);
+
+// set a param of the unit at position in every voice of a group
+void null_manager_voices_param(NullUnitManager* manager, unsigned int groupId, unsigned int position, unsigned int paramId, NullUnitParamValue value, float timefromNowInSeconds);
+
 // get a param of a unit
 NullUnitParamValue* null_manager_get_param(NullUnitManager* manager, unsigned int unitSourceId, unsigned int paramId);
 
@@ -109,11 +543,243 @@ NullUnitParamValue* null_manager_get_param(NullUnitManager* manager, unsigned in
 NullUnitnInfo* null_manager_get_info(NullUnitManager* manager, unsigned int unitSourceId);
 
 
+// get the interleaved input/output block of a loaded unit (manager->block * NULL_MAX_CHANNELS floats)
+// input is the unit's own block (that inputs get mixed into), output is wherever the unit writes (bus slot, if it has one)
+float* null_unit_block_in(NullUnit* unit);
+float* null_unit_block_out(NullUnit* unit);
+
+// run frames (starting at offset) of a block through a unit (block_in -> block_out), with process_block if it has it, or process() for each sample
+bool null_unit_process(NullUnit* unit, unsigned int offset, unsigned int frames, unsigned int channels, float sampleRate, double blockTime);
+
+// audio thread: ask a unit (that exports them) how long its output goes on after input is silent, and if it's sleeping
+uint32_t null_unit_tail(NullUnit* unit, float sampleRate);
+bool null_unit_sleeping(NullUnit* unit);
+
+// audio thread: set a param in a unit
+void null_unit_set_param(NullUnit* unit, unsigned int paramId, NullUnitParamValue value);
+
 // load list of wasm files in a dir into manager->available_units
 void null_manager_get_units(NullUnitManager* manager, const char* dirname);
 
 // just read a file as bytes
 unsigned char* null_manager_read_file(char* filename, int* bytesRead);
 
-// run on every audio-frame (put in your update-loop)
-void null_manager_process();
+// map a whole file (MAP_PRIVATE, read lazily), NULL if it can't be
+// writable pages are copy-on-write, fd (if not NULL) gets the open file, so it can be mapped again
+unsigned char* null_manager_map_file(const char* filename, size_t* size, bool writable, int* fd);
+
+// unmap a file from null_manager_map_file
+void null_manager_unmap_file(void* data, size_t size);
+
+// dir of an on-disk cache (made if it's not there), false if there is none
+// $env overrides it ("off" to not use a cache), otherwise it's nullunits/name in $XDG_CACHE_HOME (or ~/.cache)
+bool null_cache_dir(const char* env, const char* name, char* out, size_t size);
+
+// run often on the control thread (put in your update-loop)
+void null_manager_process(NullUnitManager* manager);
+
+// compile connections into a new plan, and hand it to the audio thread (or, in a batch, mark that it needs it)
+void null_manager_compile(NullUnitManager* manager);
+
+// compile connections into a new plan
+NullUnitPlan* null_plan_compile(NullUnitManager* manager);
+
+// compile connections between units (by id) into a plan, with no serial yet (can run on any thread)
+NullUnitPlan* null_plan_build(NullUnit** units, unsigned int unitCount, NullUnitConnection* connections, unsigned int connectionCount);
+
+// control thread: queue a command for the audio thread (waits a bit if the ring is full)
+// in a batch, it's held till the batch ends
+bool null_manager_send(NullUnitManager* manager, NullCommand* command);
+
+// start a batch: loads, connects and params after this go live together, with one compile, at null_manager_batch_end
+// batches nest (only the outermost one ends it)
+void null_manager_batch_begin(NullUnitManager* manager);
+
+// end a batch: compile the graph (if it changed), and hand audio thread everything at once, so it's applied in one block
+void null_manager_batch_end(NullUnitManager* manager);
+
+// start loading a patch on a background thread (build sets it up), live units keep playing meanwhile
+NullPatch* null_patch_preload(NullUnitManager* manager, NullPatchBuild build, void* data);
+
+// true once a patch is loaded and compiled, and can be switched to
+bool null_patch_ready(NullPatch* patch);
+
+// preload thread: load a unit into a patch, returns its id (ids start at 1, like a fresh manager), or NULL_UNIT_INVALID
+unsigned int null_patch_load(NullPatch* patch, const char* name);
+
+// preload thread: connect units of a patch (0 is audioOut)
+void null_patch_connect(NullPatch* patch, unsigned int unitSourceId, unsigned int unitSourcePort, unsigned int unitDestinationId, unsigned int unitDestinationPort);
+
+// preload thread: set a param of a patch unit (it's not live, so it's set right away)
+void null_patch_set_param(NullPatch* patch, unsigned int unitId, unsigned int paramId, NullUnitParamValue value);
+
+// free a patch that wasn't switched to (waits for it to finish loading)
+void null_patch_free(NullPatch* patch);
+
+// switch to a loaded patch: its plan goes live at the next block (crossfading for fadeSeconds, if > 0), and every unit
+// that was live is freed once audio thread is done with it. false (and patch is still yours) if it's not ready, or
+// the command queue is full
+bool null_manager_patch_switch(NullUnitManager* manager, NullPatch* patch, float fadeSeconds);
+
+// free a plan
+void null_plan_free(NullUnitPlan* plan);
+
+// control thread: give the events and ramps a unit still has back to the pools (once audio thread is done with it)
+void null_unit_return_events(NullUnitManager* manager, NullUnit* unit);
+
+// audio thread: apply commands, and run every unit in the plan for a block of frames
+void null_manager_render(NullUnitManager* manager, unsigned int frames);
+
+// audio thread: apply queued commands, at a block boundary
+void null_manager_apply_commands(NullUnitManager* manager);
+
+// audio thread: sum what's connected to audioOut for one channel of the last rendered block, into dest (every step bytes)
+void null_manager_mix_output(NullUnitManager* manager, unsigned int frames, unsigned int channel, char* dest, int step);
+
+// render seconds of audio (offline) to a file: .wav is 32-bit float WAV, anything else is raw interleaved float32
+// returns the realtime factor it managed, or 0 on error
+double null_manager_render_file(NullUnitManager* manager, const char* filename, double seconds, unsigned int channels);
+
+// audio thread (or a worker): mix a node's inputs, then run it for a block
+void null_manager_render_node(NullUnitManager* manager, NullUnitPlanNode* node, uint64_t blockStart, unsigned int frames);
+
+// render with this many threads (audio thread included), 0 for one per core
+void null_manager_set_threads(NullUnitManager* manager, unsigned int threads);
+
+// audio thread: run every node of plan for a block, on the audio thread and the workers
+void null_workers_render(NullWorkers* workers, NullUnitPlan* plan, uint64_t blockStart, unsigned int frames);
+
+// stop and free the workers (after audio has stopped)
+void null_workers_free(NullWorkers* workers);
+
+// set up the wasm runtime for the calling thread, if it's not already
+void null_workers_thread_init(void);
+
+// set how render threads are set up for realtime work (before null_manager_set_threads), manager takes realtime->cpus
+void null_manager_set_realtime(NullUnitManager* manager, NullRealtime* realtime);
+
+// cores from a list like "2,3" or "2-5", false if it isn't one
+bool null_realtime_cpus_from_list(const char* list, cvector_vector_type(int)* cpus);
+
+// how many cores the calling thread may run on (what its cpuset, or taskset, allows), at least 1
+unsigned int null_realtime_cores(void);
+
+// render thread: set itself up for realtime work, if it's not already (index 0 is the audio thread, then workers)
+void null_realtime_thread(NullUnitManager* manager, unsigned int index);
+
+// lock all memory, if realtime asked for it (once everything is loaded)
+void null_manager_lock_memory(NullUnitManager* manager);
+
+// now, in ns (monotonic)
+static inline uint64_t null_stats_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((uint64_t)ts.tv_sec * 1000000000ull) + (uint64_t)ts.tv_nsec;
+}
+
+// render thread: add a block of frames that took ns
+void null_stats_record(NullStats* stats, uint64_t ns, unsigned int frames, unsigned int sampleRate);
+
+// read stats (while they are written, so they can be a block apart)
+void null_stats_read(NullStats* stats, unsigned int sampleRate, NullStatsReport* report);
+
+// start stats over
+void null_stats_reset(NullStats* stats);
+
+// device underflowed: note it, with what the audio thread was doing (called from libsoundio)
+void null_xrun_record(NullUnitManager* manager);
+
+// control thread: take xruns from the audio thread, report them on stderr, and keep the recent ones
+void null_xruns_collect(NullUnitManager* manager);
+
+// control thread: recent xrun i (0 is the oldest kept), NULL past the end
+NullXrun* null_xrun_recent(NullUnitManager* manager, unsigned int i);
+
+// name of a command type
+const char* null_command_name(NullCommandType type);
+
+// hash len bytes of data into out (sha256)
+void null_sha256(const uint8_t* data, size_t len, uint8_t out[32]);
+
+// hex string of a hash (out must hold 65 chars)
+void null_sha256_hex(const uint8_t hash[32], char* out);
+
+// set up the AOT cache dir, and the thread that fills it, NULL if there is no AOT (or nowhere to put it)
+NullAotCache* null_aot_cache_create(void);
+
+// path of cached .aot for a .wasm (by its content hash), true if it's there
+bool null_aot_cache_path(NullAotCache* cache, const uint8_t hash[32], char* out, size_t size);
+
+// compile a .wasm into the AOT cache in the background (if it's not already there)
+void null_aot_cache_compile(NullAotCache* cache, const char* wasmPath);
+
+// true once nothing is queued or compiling
+bool null_aot_cache_idle(NullAotCache* cache);
+
+// stop compiling and free the AOT cache
+void null_aot_cache_free(NullAotCache* cache);
+
+// set up the shared audio bus, NULL if it can't be (units copy their input then)
+NullBus* null_bus_create(unsigned int block);
+
+// free the shared audio bus
+void null_bus_free(NullBus* bus);
+
+// give a unit a slot of the bus for its output (0 if bus is full, or not there)
+int null_bus_slot_alloc(NullBus* bus);
+
+// give a slot back
+void null_bus_slot_free(NullBus* bus, int slot);
+
+// host pointer to a slot of the bus
+float* null_bus_slot(NullBus* bus, int slot);
+
+// app-offset of a window of a (mapped) unit's view of the bus
+uint32_t null_bus_window_app(NullBus* bus, NullUnit* unit, int window);
+
+// map a wasm unit's own slot of the bus into its memory, false if it can't be (then it reads and writes its own blocks)
+bool null_bus_map_unit(NullBus* bus, NullUnit* unit);
+
+// window of a unit's view of the bus that a slot is mapped into (for a plan to read in place), -1 if there's no room
+int null_bus_window(NullBus* bus, NullUnit* unit, int slot);
+
+// a plan is done reading from a window
+void null_bus_window_release(NullUnit* unit, int window);
+
+// is a unit's output in the bus (so a mapped unit can read it in place)?
+bool null_unit_bus_out(NullUnit* unit);
+
+// anonymous shared memory object of size bytes, -1 if it can't be made
+int null_shared_fd(const char* name, size_t size);
+
+// add a sample (copied into the sample bank, so caller keeps data), returns its id, or -1
+int null_manager_add_sample(NullUnitManager* manager, const float* data, int len);
+
+// add a sample file (raw floats), mapped from disk (pages are read when they're used), returns its id, or -1
+int null_manager_load_sample(NullUnitManager* manager, const char* filename);
+
+// load sample files (WAV/AIFF/FLAC are decoded, in parallel, at engine rate, anything else is raw floats)
+// ids gets each one's sample id (-1 if it didn't load)
+void null_manager_load_samples(NullUnitManager* manager, char** filenames, size_t count, int* ids);
+
+// free all samples, and the sample bank
+void null_manager_free_samples(NullUnitManager* manager);
+
+// map samples into a wasm unit's memory (as many as fit under NULL_SAMPLE_VIEW_MAX), false if none can be (then it can only copy samples out)
+bool null_samples_map_unit(NullUnitManager* manager, NullUnit* unit);
+
+// app-offset of a sample mapped into a unit's memory, 0 if it's not there
+uint32_t null_unit_sample_app(NullUnit* unit, unsigned int id);
+
+// keep the head of a mapped sample file in RAM, and stream the rest from disk (if it's bigger than that)
+void null_sample_stream(NullUnitManager* manager, NullUnitSample* sample);
+
+// copy count floats of a sample (from offset) into dest, past the end is silence
+// streamed samples come from RAM, or what was prefetched for the voice reading them (or disk, if that's not there)
+void null_sample_read(NullUnit* unit, unsigned int id, size_t offset, size_t count, float* dest);
+
+// stop prefetching, and free the streams
+void null_streams_free(NullStreams* streams);
+
+// reads of streamed samples that had to wait on the disk, because nothing was prefetched for them
+unsigned int null_streams_misses(NullStreams* streams);
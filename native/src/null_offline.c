@@ -0,0 +1,106 @@
+// offline rendering: drive the graph in a tight loop, with no device, and write it to a file
+
+#include <strings.h>
+#include <time.h>
+#include "null_manager.h"
+
+static void write_u16(FILE* file, uint16_t v) {
+  uint8_t b[2] = { v & 0xff, (v >> 8) & 0xff };
+  fwrite(b, 1, 2, file);
+}
+
+static void write_u32(FILE* file, uint32_t v) {
+  uint8_t b[4] = { v & 0xff, (v >> 8) & 0xff, (v >> 16) & 0xff, (v >> 24) & 0xff };
+  fwrite(b, 1, 4, file);
+}
+
+// 32-bit float WAV header (sizes are filled in once we know them)
+static void write_wav_header(FILE* file, unsigned int sampleRate, unsigned int channels, uint32_t frames) {
+  uint32_t dataSize = frames * channels * sizeof(float);
+  fwrite("RIFF", 1, 4, file);
+  write_u32(file, 4 + (8 + 18) + (8 + 4) + (8 + dataSize));
+  fwrite("WAVE", 1, 4, file);
+
+  fwrite("fmt ", 1, 4, file);
+  write_u32(file, 18);
+  write_u16(file, 3); // WAVE_FORMAT_IEEE_FLOAT
+  write_u16(file, channels);
+  write_u32(file, sampleRate);
+  write_u32(file, sampleRate * channels * sizeof(float));
+  write_u16(file, channels * sizeof(float));
+  write_u16(file, 32);
+  write_u16(file, 0);
+
+  fwrite("fact", 1, 4, file);
+  write_u32(file, 4);
+  write_u32(file, frames);
+
+  fwrite("data", 1, 4, file);
+  write_u32(file, dataSize);
+}
+
+static bool is_wav(const char* filename) {
+  size_t len = strlen(filename);
+  return len > 4 && strcasecmp(filename + len - 4, ".wav") == 0;
+}
+
+static double now_seconds() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + ((double)ts.tv_nsec / 1e9);
+}
+
+// render seconds of audio (offline) to a file
+double null_manager_render_file(NullUnitManager* manager, const char* filename, double seconds, unsigned int channels) {
+  if (!manager->offline) {
+    fprintf(stderr, "Can only render to file without an audio device\n");
+    return 0.0;
+  }
+  if (channels == 0) {
+    channels = manager->channels;
+  }
+
+  FILE* file = fopen(filename, "wb");
+  if (file == NULL) {
+    fprintf(stderr, "Could not open %s for writing\n", filename);
+    return 0.0;
+  }
+
+  bool wav = is_wav(filename);
+  uint64_t total = (uint64_t)llround(seconds * manager->sample_rate);
+  if (wav && total * channels * sizeof(float) > UINT32_MAX - 64) {
+    fprintf(stderr, "%s is too long for a WAV file\n", filename);
+    fclose(file);
+    return 0.0;
+  }
+  if (wav) {
+    write_wav_header(file, manager->sample_rate, channels, (uint32_t)total);
+  }
+
+  float* out = malloc(manager->block * channels * sizeof(float));
+  uint64_t rendered = 0;
+  double start = now_seconds();
+  while (rendered < total) {
+    unsigned int frames = total - rendered < manager->block ? (unsigned int)(total - rendered) : manager->block;
+    null_manager_render(manager, frames);
+    for (unsigned int channel = 0; channel < channels; channel++) {
+      null_manager_mix_output(manager, frames, channel, (char*)(out + channel), channels * sizeof(float));
+    }
+    if (fwrite(out, sizeof(float) * channels, frames, file) != frames) {
+      fprintf(stderr, "Could not write to %s\n", filename);
+      break;
+    }
+    rendered += frames;
+
+    // this thread is the control thread too
+    null_manager_process(manager);
+  }
+  double elapsed = now_seconds() - start;
+  free(out);
+  fclose(file);
+
+  double renderedSeconds = (double)rendered / manager->sample_rate;
+  double factor = elapsed > 0.0 ? renderedSeconds / elapsed : 0.0;
+  printf("rendered %.2fs to %s in %.3fs (%.1fx realtime)\n", renderedSeconds, filename, elapsed, factor);
+  return rendered == total ? factor : 0.0;
+}
@@ -0,0 +1,161 @@
+// patches loaded in the background: units are made (and their main() run), and the graph is compiled, on a preload
+// thread, while whatever is live keeps playing. switching to it is one plan swap at a block boundary, like any
+// other compile, and units that were live are freed on the control thread once the audio thread is done with them.
+// a patch's unit ids are its own (from 1, like a fresh manager), so a bundle made for a fresh start works in it.
+
+#include "null_manager.h"
+
+struct NullPatch {
+  NullUnitManager* manager;
+  cvector_vector_type(NullUnit*) units; // 0 is the manager's audioOut
+  cvector_vector_type(NullUnitConnection) connections;
+  NullUnitPlan* plan; // compiled, once it's ready
+  NullPatchBuild build;
+  void* data;
+  pthread_t thread;
+  bool joined; // control thread: preload thread is done, and joined
+  atomic_bool ready;
+};
+
+// control thread: wait for the preload thread (once)
+static void patch_join(NullPatch* patch) {
+  if (!patch->joined) {
+    pthread_join(patch->thread, NULL);
+    patch->joined = true;
+  }
+}
+
+static void* patch_thread(void* arg) {
+  NullPatch* patch = (NullPatch*)arg;
+  null_workers_thread_init();
+  patch->build(patch, patch->data);
+  patch->plan = null_plan_build(patch->units, cvector_size(patch->units), patch->connections, cvector_size(patch->connections));
+  atomic_store_explicit(&patch->ready, true, memory_order_release);
+  return NULL;
+}
+
+// start loading a patch on a background thread
+NullPatch* null_patch_preload(NullUnitManager* manager, NullPatchBuild build, void* data) {
+  NullPatch* patch = calloc(1, sizeof(NullPatch));
+  patch->manager = manager;
+  patch->build = build;
+  patch->data = data;
+  cvector_push_back(patch->units, manager->units[0]);
+  if (pthread_create(&patch->thread, NULL, patch_thread, patch) != 0) {
+    fprintf(stderr, "Could not start patch preload thread\n");
+    cvector_free(patch->units);
+    free(patch);
+    return NULL;
+  }
+  return patch;
+}
+
+// true once a patch is loaded and compiled
+bool null_patch_ready(NullPatch* patch) {
+  return patch != NULL && atomic_load_explicit(&patch->ready, memory_order_acquire);
+}
+
+// preload thread: load a unit into a patch
+unsigned int null_patch_load(NullPatch* patch, const char* name) {
+  unsigned int id = cvector_size(patch->units);
+  NullUnit* unit = null_unit_create(patch->manager, name, id);
+  if (unit == NULL) {
+    return NULL_UNIT_INVALID;
+  }
+  cvector_push_back(patch->units, unit);
+  return id;
+}
+
+// preload thread: connect units of a patch
+void null_patch_connect(NullPatch* patch, unsigned int unitSourceId, unsigned int unitSourcePort, unsigned int unitDestinationId, unsigned int unitDestinationPort) {
+  unsigned int unitCount = cvector_size(patch->units);
+  if (unitSourceId == 0 || unitSourceId >= unitCount || unitDestinationId >= unitCount) {
+    fprintf(stderr, "Invalid patch connection: %u -> %u\n", unitSourceId, unitDestinationId);
+    return;
+  }
+  NullUnitConnection connection = {
+    .source = unitSourceId,
+    .sourcePort = unitSourcePort,
+    .destination = unitDestinationId,
+    .destinationPort = unitDestinationPort
+  };
+  for (size_t i = 0; i < cvector_size(patch->connections); i++) {
+    if (memcmp(&patch->connections[i], &connection, sizeof(connection)) == 0) {
+      return;
+    }
+  }
+  cvector_push_back(patch->connections, connection);
+}
+
+// preload thread: set a param of a patch unit
+void null_patch_set_param(NullPatch* patch, unsigned int unitId, unsigned int paramId, NullUnitParamValue value) {
+  if (unitId == 0 || unitId >= cvector_size(patch->units)) {
+    return;
+  }
+  NullUnit* unit = patch->units[unitId];
+  if (paramId >= cvector_size(unit->info->params)) {
+    return;
+  }
+  unit->info->params[paramId]->value = value;
+  null_unit_set_param(unit, paramId, value);
+}
+
+// free a patch that wasn't switched to
+void null_patch_free(NullPatch* patch) {
+  if (patch == NULL) {
+    return;
+  }
+  patch_join(patch);
+  // plan first, it lets go of the units' bus windows
+  null_plan_free(patch->plan);
+  for (size_t i = 1; i < cvector_size(patch->units); i++) {
+    null_unit_free(patch->units[i]);
+  }
+  cvector_free(patch->units);
+  cvector_free(patch->connections);
+  free(patch);
+}
+
+// switch to a loaded patch
+bool null_manager_patch_switch(NullUnitManager* manager, NullPatch* patch, float fadeSeconds) {
+  if (!null_patch_ready(patch)) {
+    return false;
+  }
+  patch_join(patch);
+
+  // all the audio thread gets is the plan: old units' events are given back when they are freed (on this thread)
+  NullUnitPlan* plan = patch->plan;
+  plan->serial = ++manager->plan_serial_next;
+  uint32_t fade = fadeSeconds > 0.0f ? (uint32_t)lroundf(fadeSeconds * manager->sample_rate) : 0;
+  NullCommand command = {
+    .type = NULL_COMMAND_PLAN,
+    .plan = plan,
+    .serial = plan->serial,
+    .duration = fade
+  };
+  if (!null_manager_send(manager, &command)) {
+    return false;
+  }
+
+  for (size_t i = 1; i < cvector_size(manager->units); i++) {
+    NullUnit* unit = manager->units[i];
+    if (unit == NULL) {
+      continue;
+    }
+    NullUnitGarbage garbage = {
+      .unit = unit,
+      .serial = plan->serial
+    };
+    cvector_push_back(manager->garbage, garbage);
+  }
+  cvector_free(manager->units);
+  cvector_free(manager->connections);
+  manager->units = patch->units;
+  manager->connections = patch->connections;
+
+  // plan is already compiled from exactly these, so a batch that is open doesn't need another
+  manager->batch_compile = false;
+
+  free(patch);
+  return true;
+}
@@ -0,0 +1,177 @@
+// setting up render threads (the audio thread, and workers) for realtime work: denormals flushed to zero (feedback
+// units decay into them, and they can be ~100x slower on x86), SCHED_FIFO priority, pinned cores, and memory locked
+// once everything is loaded, so the audio thread doesn't page-fault. none of it is fatal: what can't be done is
+// reported, and things go on without it.
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include "null_manager.h"
+
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+#ifndef CPU_SETSIZE
+#define CPU_SETSIZE 1024
+#endif
+
+// flush denormals to zero (and treat them as zero) on the calling thread, false if it can't be done here
+static bool realtime_ftz(void) {
+#if defined(__SSE__)
+  // FTZ is bit 15, DAZ is bit 6
+  _mm_setcsr(_mm_getcsr() | 0x8040);
+  return true;
+#elif defined(__aarch64__)
+  // FZ is bit 24 (it covers inputs too)
+  uint64_t fpcr;
+  __asm__ __volatile__("mrs %0, fpcr" : "=r"(fpcr));
+  __asm__ __volatile__("msr fpcr, %0" : : "r"(fpcr | (1ull << 24)));
+  return true;
+#else
+  return false;
+#endif
+}
+
+// give the calling thread SCHED_FIFO priority
+static void realtime_priority(int priority, unsigned int index) {
+  struct sched_param param = { .sched_priority = priority };
+  int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+  if (err == EPERM) {
+    fprintf(stderr, "Could not give render thread %u realtime priority: not permitted (it needs an rtprio limit, or CAP_SYS_NICE)\n", index);
+  } else if (err != 0) {
+    fprintf(stderr, "Could not give render thread %u realtime priority: %s\n", index, strerror(err));
+  }
+}
+
+// pin the calling thread to a core
+static void realtime_pin(int core, unsigned int index) {
+#ifdef __linux__
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  CPU_SET(core, &cpus);
+  int err = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpus);
+  if (err != 0) {
+    fprintf(stderr, "Could not pin render thread %u to core %d: %s\n", index, core, strerror(err));
+  }
+#endif
+}
+
+// the n-th (round-robin) of the cores the calling thread may run on (a cpuset, or taskset, can leave some out),
+// -1 if that can't be told
+static int realtime_allowed_core(unsigned int n) {
+#ifdef __linux__
+  cpu_set_t cpus;
+  if (sched_getaffinity(0, sizeof(cpu_set_t), &cpus) != 0 || CPU_COUNT(&cpus) == 0) {
+    return -1;
+  }
+  n %= (unsigned int)CPU_COUNT(&cpus);
+  for (int core = 0; core < CPU_SETSIZE; core++) {
+    if (CPU_ISSET(core, &cpus) && n-- == 0) {
+      return core;
+    }
+  }
+#endif
+  return -1;
+}
+
+// how many cores the calling thread may run on (at least 1)
+unsigned int null_realtime_cores(void) {
+#ifdef __linux__
+  cpu_set_t cpus;
+  if (sched_getaffinity(0, sizeof(cpu_set_t), &cpus) == 0 && CPU_COUNT(&cpus) > 0) {
+    return (unsigned int)CPU_COUNT(&cpus);
+  }
+#endif
+  long cores = sysconf(_SC_NPROCESSORS_ONLN);
+  return cores < 1 ? 1 : (unsigned int)cores;
+}
+
+// set how render threads are set up (before null_manager_set_threads), manager takes realtime->cpus
+void null_manager_set_realtime(NullUnitManager* manager, NullRealtime* realtime) {
+  cvector_free(manager->realtime.cpus);
+  manager->realtime = *realtime;
+  realtime->cpus = NULL;
+  atomic_fetch_add(&manager->realtime_serial, 1);
+}
+
+// cores from a list like "2,3" or "2-5", false if it isn't one
+bool null_realtime_cpus_from_list(const char* list, cvector_vector_type(int)* cpus) {
+  const char* s = list;
+  while (*s != '\0') {
+    char* end;
+    long first = strtol(s, &end, 10);
+    if (end == s || first < 0 || first >= CPU_SETSIZE) {
+      return false;
+    }
+    long last = first;
+    s = end;
+    if (*s == '-') {
+      last = strtol(s + 1, &end, 10);
+      if (end == s + 1 || last < first || last >= CPU_SETSIZE) {
+        return false;
+      }
+      s = end;
+    }
+    for (long core = first; core <= last; core++) {
+      cvector_push_back(*cpus, (int)core);
+    }
+    if (*s == ',') {
+      s++;
+    } else if (*s != '\0') {
+      return false;
+    }
+  }
+  return cvector_size(*cpus) > 0;
+}
+
+// render thread: set itself up, if it's not already (index 0 is the audio thread, then workers)
+void null_realtime_thread(NullUnitManager* manager, unsigned int index) {
+  static _Thread_local unsigned int seen = 0;
+  unsigned int serial = atomic_load_explicit(&manager->realtime_serial, memory_order_acquire);
+  if (seen == serial) {
+    return;
+  }
+  seen = serial;
+
+  NullRealtime* realtime = &manager->realtime;
+  if (realtime->ftz && !realtime_ftz()) {
+    fprintf(stderr, "Could not flush denormals to zero on render thread %u: not supported on this CPU\n", index);
+  }
+
+  // offline, the audio thread is whoever renders, so it's left alone
+  if (manager->offline && index == 0) {
+    return;
+  }
+  if (realtime->priority > 0) {
+    realtime_priority(realtime->priority, index);
+  }
+  if (cvector_size(realtime->cpus) > 0) {
+    realtime_pin(realtime->cpus[index % cvector_size(realtime->cpus)], index);
+  } else if (index > 0) {
+    // workers get a core each (round-robin over the ones the process may use, past the audio thread's)
+    int core = realtime_allowed_core(index);
+    if (core >= 0) {
+      realtime_pin(core, index);
+    }
+  }
+}
+
+// lock all memory (what is mapped now, and later, as it's touched), if that was asked for
+void null_manager_lock_memory(NullUnitManager* manager) {
+  if (!manager->realtime.lock_memory) {
+    return;
+  }
+  int flags = MCL_CURRENT | MCL_FUTURE;
+#ifdef MCL_ONFAULT
+  // not up-front: sample files are mapped so they are only read as they play, and unit memory is mostly reserved
+  flags |= MCL_ONFAULT;
+#endif
+  if (mlockall(flags) != 0) {
+    fprintf(stderr, "Could not lock memory: %s%s\n", strerror(errno), errno == ENOMEM || errno == EPERM ? " (raise the memlock limit)" : "");
+    return;
+  }
+  printf("memory locked\n");
+}
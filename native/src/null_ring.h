@@ -0,0 +1,90 @@
+#pragma once
+
+// lock-free single-producer/single-consumer ring of commands
+// control thread -> audio thread (commands), and audio thread -> control thread (completions)
+// neither side ever blocks or allocates after null_ring_init
+// included from null_manager.h, after the unit/plan types
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// must be a power of 2
+#define NULL_RING_SIZE 1024
+
+// things the control thread can ask the audio thread to do (and get back)
+typedef enum {
+  NULL_COMMAND_PLAN,      // swap in plan (completion gives back the old one, after crossfading for duration)
+  NULL_COMMAND_SET_PARAM, // set param of unit to value, at frame
+  NULL_COMMAND_RAMP,      // ramp param of unit to value, over duration frames
+  NULL_COMMAND_UNLOAD,    // unit is going away, drop anything audio thread has for it
+  NULL_COMMAND_NOTE       // voice group (unit) starts note (param) at velocity (value.f), or stops it (0)
+} NullCommandType;
+
+typedef struct {
+  NullCommandType type;
+  NullUnit* unit;
+  NullUnitPlan* plan;
+  unsigned int param;
+  NullUnitParamValue value;
+  uint64_t frame; // when to set param (absolute sample frame)
+  uint32_t duration; // ramp (or plan crossfade) length, in frames
+  NullRampCurve curve;
+  unsigned int serial; // plan serial
+} NullCommand;
+
+typedef struct {
+  NullCommand items[NULL_RING_SIZE];
+  _Alignas(64) atomic_uint head; // next slot to write (producer)
+  _Alignas(64) atomic_uint tail; // next slot to read (consumer)
+} NullRing;
+
+static inline void null_ring_init(NullRing* ring) {
+  atomic_init(&ring->head, 0);
+  atomic_init(&ring->tail, 0);
+}
+
+// how many commands can be pushed right now
+static inline unsigned int null_ring_free_count(NullRing* ring) {
+  unsigned int head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  unsigned int tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+  return NULL_RING_SIZE - (head - tail);
+}
+
+// producer: add a command, false if full
+static inline bool null_ring_push(NullRing* ring, const NullCommand* command) {
+  unsigned int head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  unsigned int tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+  if (head - tail >= NULL_RING_SIZE) {
+    return false;
+  }
+  ring->items[head & (NULL_RING_SIZE - 1)] = *command;
+  atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+  return true;
+}
+
+// producer: add count commands, all at once (consumer sees all of them, or none), false if there isn't room for all
+static inline bool null_ring_push_many(NullRing* ring, const NullCommand* commands, unsigned int count) {
+  unsigned int head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  unsigned int tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+  if (count > NULL_RING_SIZE - (head - tail)) {
+    return false;
+  }
+  for (unsigned int i = 0; i < count; i++) {
+    ring->items[(head + i) & (NULL_RING_SIZE - 1)] = commands[i];
+  }
+  atomic_store_explicit(&ring->head, head + count, memory_order_release);
+  return true;
+}
+
+// consumer: take a command, false if empty
+static inline bool null_ring_pop(NullRing* ring, NullCommand* command) {
+  unsigned int tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+  unsigned int head = atomic_load_explicit(&ring->head, memory_order_acquire);
+  if (tail == head) {
+    return false;
+  }
+  *command = ring->items[tail & (NULL_RING_SIZE - 1)];
+  atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+  return true;
+}
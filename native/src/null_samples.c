@@ -0,0 +1,170 @@
+// samples, shared with units: a sample file is mapped (MAP_PRIVATE, read-only) so its pages are only read from disk
+// when they are played, and are shared in the page cache by every process that has it. in-memory samples (built-ins,
+// anything decoded) are copied once into a bank (one shared memory object).
+// a wasm unit that imports get_data_ptr() gets samples mapped into its linear memory when it loads (each one that fits
+// in NULL_SAMPLE_VIEW_MAX), so it can be handed a pointer to a sample, with no copy at all. a sample that isn't mapped
+// (no hardware bounds checks, or past the cap) is still there for get_data_floats().
+
+#define _GNU_SOURCE
+#include <sys/mman.h>
+#include "null_manager.h"
+
+static size_t page_size(void) {
+  return (size_t)sysconf(_SC_PAGESIZE);
+}
+
+static size_t page_round(size_t size) {
+  return (size + page_size() - 1) / page_size() * page_size();
+}
+
+static int push_sample(NullUnitManager* manager, NullUnitSample sample) {
+  if (sample.channels == 0) {
+    sample.channels = 1;
+  }
+  cvector_push_back(manager->samples, sample);
+  return (int)cvector_size(manager->samples) - 1;
+}
+
+// add a sample (copied into the bank, so caller keeps data), returns its id, or -1
+int null_manager_add_sample(NullUnitManager* manager, const float* data, int len) {
+  if (len <= 0) {
+    return -1;
+  }
+  NullUnitSample sample = { .len=len, .fd=-1 };
+
+  if (manager->sample_fd < 0 && !manager->sample_fd_tried) {
+    manager->sample_fd_tried = true;
+    manager->sample_fd = null_shared_fd("nullunits-samples", 0);
+    if (manager->sample_fd < 0) {
+      fprintf(stderr, "Could not make sample bank, units will copy samples\n");
+    }
+  }
+
+  if (manager->sample_fd >= 0) {
+    size_t offset = manager->sample_bank_size;
+    size_t size = page_round(len);
+    if (ftruncate(manager->sample_fd, offset + size) == 0 && pwrite(manager->sample_fd, data, len, offset) == len) {
+      void* mapped = mmap(NULL, len, PROT_READ, MAP_SHARED, manager->sample_fd, offset);
+      if (mapped != MAP_FAILED) {
+        sample.data = mapped;
+        sample.fd = manager->sample_fd;
+        sample.offset = offset;
+        manager->sample_bank_size = offset + size;
+      }
+    }
+  }
+
+  // no bank (or it's full), so it's just host memory
+  if (sample.data == NULL) {
+    sample.data = malloc(len);
+    memcpy(sample.data, data, len);
+  }
+
+  return push_sample(manager, sample);
+}
+
+// add a sample file (raw floats), mapped from disk, not read, returns its id, or -1
+int null_manager_load_sample(NullUnitManager* manager, const char* filename) {
+  size_t size;
+  int fd;
+  unsigned char* data = null_manager_map_file(filename, &size, false, &fd);
+  if (data == NULL) {
+    return -1;
+  }
+  if (size > INT32_MAX) {
+    fprintf(stderr, "%s is too big for a sample\n", filename);
+    null_manager_unmap_file(data, size);
+    close(fd);
+    return -1;
+  }
+  // no read-ahead through the whole file (a sampler jumps around, and big ones are streamed), but have the start ready
+  madvise(data, size, MADV_RANDOM);
+  madvise(data, size < NULL_SAMPLE_HEAD ? size : NULL_SAMPLE_HEAD, MADV_WILLNEED);
+
+  NullUnitSample sample = { .data=(float*)data, .len=(int)size, .fd=fd, .offset=0 };
+  null_sample_stream(manager, &sample);
+  return push_sample(manager, sample);
+}
+
+// free all samples, and the bank
+void null_manager_free_samples(NullUnitManager* manager) {
+  null_streams_free(manager->streams);
+  manager->streams = NULL;
+  for (size_t i = 0; i < cvector_size(manager->samples); i++) {
+    NullUnitSample* sample = &manager->samples[i];
+    free(sample->head);
+    if (sample->fd >= 0) {
+      munmap(sample->data, sample->len);
+      if (sample->fd != manager->sample_fd) {
+        close(sample->fd);
+      }
+    } else {
+      free(sample->data);
+    }
+  }
+  cvector_free(manager->samples);
+  manager->samples = NULL;
+  if (manager->sample_fd >= 0) {
+    close(manager->sample_fd);
+  }
+  manager->sample_fd = -1;
+  manager->sample_bank_size = 0;
+}
+
+// map samples (as they are now) into a wasm unit's memory, each in its own page-aligned place, in id order while they
+// fit in NULL_SAMPLE_VIEW_MAX, false if none can be
+bool null_samples_map_unit(NullUnitManager* manager, NullUnit* unit) {
+#if NULL_WAMR_HW_BOUND_CHECK
+  size_t page = page_size();
+  unsigned int count = cvector_size(manager->samples);
+  size_t* places = calloc(count ? count : 1, sizeof(size_t)); // where each one goes in the view, + 1 (0 if it doesn't)
+  size_t size = 0;
+  for (unsigned int i = 0; i < count; i++) {
+    NullUnitSample* sample = &manager->samples[i];
+    size_t rounded = page_round(sample->len);
+    if (sample->fd < 0 || size + rounded > NULL_SAMPLE_VIEW_MAX) {
+      continue;
+    }
+    places[i] = size + 1;
+    size += rounded;
+  }
+  uint32_t region = size > 0 ? wasm_runtime_module_malloc(unit->module_inst, size + page, NULL) : 0;
+  if (region == 0) {
+    free(places);
+    return false;
+  }
+  uint8_t* native = wasm_runtime_addr_app_to_native(unit->module_inst, region);
+  uint8_t* aligned = (uint8_t*)(((uintptr_t)native + page - 1) & ~(uintptr_t)(page - 1));
+  uint32_t view = region + (uint32_t)(aligned - native);
+
+  unit->sample_apps = calloc(count, sizeof(uint32_t));
+  unit->sample_app_count = count;
+  for (unsigned int i = 0; i < count; i++) {
+    NullUnitSample* sample = &manager->samples[i];
+    if (places[i] == 0) {
+      continue;
+    }
+    uint8_t* place = aligned + places[i] - 1;
+    int flags = (sample->fd == manager->sample_fd ? MAP_SHARED : MAP_PRIVATE) | MAP_FIXED;
+    if (mmap(place, sample->len, PROT_READ, flags, sample->fd, sample->offset) == MAP_FAILED) {
+      // put plain memory back, so the unit doesn't trip over a read-only hole in its heap
+      mmap(place, page_round(sample->len), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+      continue;
+    }
+    unit->sample_apps[i] = view + (uint32_t)(places[i] - 1);
+  }
+  free(places);
+  return true;
+#else
+  // without hardware bounds checks, WAMR moves unit memory when it grows, so the mapping would not stay put
+  return false;
+#endif
+}
+
+// app-offset of a sample in a unit's memory, 0 if it's not mapped there
+uint32_t null_unit_sample_app(NullUnit* unit, unsigned int id) {
+  if (id >= unit->sample_app_count) {
+    return 0;
+  }
+  return unit->sample_apps[id];
+}
@@ -0,0 +1,59 @@
+// DSP profiling: every node is timed (CLOCK_MONOTONIC) each block, into its unit's stats, and so is the whole block.
+// stats are only ever added to (with relaxed atomics) by the render thread that ran the unit, so the control
+// thread can read them any time, without stopping audio. a read can be a block out, which is fine for this.
+
+#include "null_manager.h"
+
+// render thread: add a block of frames that took ns
+void null_stats_record(NullStats* stats, uint64_t ns, unsigned int frames, unsigned int sampleRate) {
+  atomic_fetch_add_explicit(&stats->blocks, 1, memory_order_relaxed);
+  atomic_fetch_add_explicit(&stats->frames, frames, memory_order_relaxed);
+  atomic_fetch_add_explicit(&stats->ns, ns, memory_order_relaxed);
+
+  unsigned int bucket = ns == 0 ? 0 : 63 - __builtin_clzll(ns);
+  if (bucket >= NULL_STATS_BUCKETS) {
+    bucket = NULL_STATS_BUCKETS - 1;
+  }
+  atomic_fetch_add_explicit(&stats->histogram[bucket], 1, memory_order_relaxed);
+
+  // only one thread runs a unit at a time, so worst case doesn't need a compare-exchange
+  if (ns > atomic_load_explicit(&stats->worst_ns, memory_order_relaxed)) {
+    atomic_store_explicit(&stats->worst_ns, ns, memory_order_relaxed);
+  }
+  if (frames > 0) {
+    uint64_t load = (ns * sampleRate) / ((uint64_t)frames * 1000);
+    if (load > UINT32_MAX) {
+      load = UINT32_MAX;
+    }
+    if (load > atomic_load_explicit(&stats->worst_load, memory_order_relaxed)) {
+      atomic_store_explicit(&stats->worst_load, (uint32_t)load, memory_order_relaxed);
+    }
+  }
+}
+
+// read stats (while they are written, so they can be a block apart)
+void null_stats_read(NullStats* stats, unsigned int sampleRate, NullStatsReport* report) {
+  uint64_t blocks = atomic_load_explicit(&stats->blocks, memory_order_relaxed);
+  uint64_t frames = atomic_load_explicit(&stats->frames, memory_order_relaxed);
+  uint64_t ns = atomic_load_explicit(&stats->ns, memory_order_relaxed);
+  report->blocks = blocks;
+  report->mean_ns = blocks > 0 ? (double)ns / blocks : 0.0;
+  report->load = frames > 0 ? ((double)ns * sampleRate) / ((double)frames * 1e7) : 0.0;
+  report->worst_ns = atomic_load_explicit(&stats->worst_ns, memory_order_relaxed);
+  report->worst_load = atomic_load_explicit(&stats->worst_load, memory_order_relaxed) / 10000.0;
+  for (int i = 0; i < NULL_STATS_BUCKETS; i++) {
+    report->histogram[i] = atomic_load_explicit(&stats->histogram[i], memory_order_relaxed);
+  }
+}
+
+// start stats over (a block that is being recorded now can land on either side)
+void null_stats_reset(NullStats* stats) {
+  atomic_store_explicit(&stats->blocks, 0, memory_order_relaxed);
+  atomic_store_explicit(&stats->frames, 0, memory_order_relaxed);
+  atomic_store_explicit(&stats->ns, 0, memory_order_relaxed);
+  atomic_store_explicit(&stats->worst_ns, 0, memory_order_relaxed);
+  atomic_store_explicit(&stats->worst_load, 0, memory_order_relaxed);
+  for (int i = 0; i < NULL_STATS_BUCKETS; i++) {
+    atomic_store_explicit(&stats->histogram[i], 0, memory_order_relaxed);
+  }
+}
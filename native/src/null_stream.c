@@ -0,0 +1,260 @@
+// streaming sample files from disk: each one keeps its head in RAM, and the rest is read ahead of whoever is
+// playing it, by a prefetch thread, into a ring buffer per voice. a voice is a unit reading a sample forward
+// (each read starts inside, or right after, the last one), so several voices of one unit can play one sample.
+// the audio thread never waits on the disk for what was prefetched; anything that wasn't (a seek, a voice
+// that outran the thread, no free streams) is read from the mapped file, which might.
+
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <time.h>
+#include "null_manager.h"
+
+// how many voices can stream at once
+#define NULL_STREAM_COUNT 64
+
+// bytes read ahead of each voice (~1.3s of mono at 48k)
+#define NULL_STREAM_RING (256 * 1024)
+
+// most the prefetch thread reads for one voice before it goes on to the next
+#define NULL_STREAM_CHUNK (64 * 1024)
+
+// seconds a voice can go without reading before its stream is given back
+#define NULL_STREAM_IDLE 0.25
+
+// how long prefetch thread sleeps when there is nothing to read
+#define NULL_STREAM_SLEEP_NS 2000000
+
+enum {
+  NULL_STREAM_FREE,
+  NULL_STREAM_CLAIMED, // audio thread is setting it up
+  NULL_STREAM_ACTIVE,
+  NULL_STREAM_READING, // audio thread is reading from it (so prefetch thread can't take it back)
+  NULL_STREAM_RECLAIM // prefetch thread is emptying it
+};
+
+typedef struct {
+  _Atomic int state;
+  atomic_uint unit; // id of unit playing it
+  atomic_uint sample;
+  size_t last; // audio thread: offset (in floats) of the voice's last read
+  size_t pos; // audio thread: end of the voice's last read
+  size_t start; // audio thread: offset of ring's read end
+  size_t fill; // prefetch thread: offset of ring's write end
+  _Atomic uint64_t used; // manager->frames when it was last read
+  struct SoundIoRingBuffer* ring;
+} NullStream;
+
+struct NullStreams {
+  NullUnitManager* manager;
+  NullStream streams[NULL_STREAM_COUNT];
+  pthread_t thread;
+  atomic_bool running;
+  atomic_uint misses; // reads that had to go to the mapped file
+};
+
+// read the next bit of a voice's sample into its ring, false if there was nothing to read
+static bool stream_fill(NullUnitManager* manager, NullStream* stream) {
+  NullUnitSample* sample = &manager->samples[stream->sample];
+  size_t end = sample->len / sizeof(float);
+  if (stream->fill >= end) {
+    return false;
+  }
+  int space = soundio_ring_buffer_free_count(stream->ring) / sizeof(float);
+  size_t count = end - stream->fill < (size_t)space ? end - stream->fill : (size_t)space;
+  if (count > NULL_STREAM_CHUNK / sizeof(float)) {
+    count = NULL_STREAM_CHUNK / sizeof(float);
+  }
+  if (count == 0) {
+    return false;
+  }
+  ssize_t got = pread(sample->fd, soundio_ring_buffer_write_ptr(stream->ring), count * sizeof(float), sample->offset + (stream->fill * sizeof(float)));
+  if (got <= 0) {
+    return false;
+  }
+  count = (size_t)got / sizeof(float);
+  stream->fill += count;
+  soundio_ring_buffer_advance_write_ptr(stream->ring, (int)(count * sizeof(float)));
+  return true;
+}
+
+static void* stream_thread(void* arg) {
+  NullStreams* streams = (NullStreams*)arg;
+  NullUnitManager* manager = streams->manager;
+  while (atomic_load(&streams->running)) {
+    bool busy = false;
+    uint64_t now = atomic_load_explicit(&manager->frames, memory_order_relaxed);
+    for (int i = 0; i < NULL_STREAM_COUNT; i++) {
+      NullStream* stream = &streams->streams[i];
+      int state = atomic_load_explicit(&stream->state, memory_order_acquire);
+      if (state != NULL_STREAM_ACTIVE && state != NULL_STREAM_READING) {
+        continue;
+      }
+      // voice stopped (or jumped somewhere else), so it's free for another
+      uint64_t used = atomic_load_explicit(&stream->used, memory_order_relaxed);
+      int expected = NULL_STREAM_ACTIVE;
+      if (now > used + (uint64_t)(NULL_STREAM_IDLE * manager->sample_rate) && atomic_compare_exchange_strong(&stream->state, &expected, NULL_STREAM_RECLAIM)) {
+        soundio_ring_buffer_clear(stream->ring);
+        atomic_store_explicit(&stream->state, NULL_STREAM_FREE, memory_order_release);
+        continue;
+      }
+      busy |= stream_fill(manager, stream);
+    }
+    if (!busy) {
+      struct timespec ts = { 0, NULL_STREAM_SLEEP_NS };
+      nanosleep(&ts, NULL);
+    }
+  }
+  return NULL;
+}
+
+// set up streaming (the first time a sample file needs it), false if it can't be
+static bool streams_start(NullUnitManager* manager) {
+  if (manager->streams != NULL) {
+    return true;
+  }
+  NullStreams* streams = calloc(1, sizeof(NullStreams));
+  streams->manager = manager;
+  for (int i = 0; i < NULL_STREAM_COUNT; i++) {
+    streams->streams[i].ring = soundio_ring_buffer_create(manager->soundio, NULL_STREAM_RING);
+    if (streams->streams[i].ring == NULL) {
+      fprintf(stderr, "Could not make sample streams, samples will be read from disk when they play\n");
+      for (int j = 0; j < i; j++) {
+        soundio_ring_buffer_destroy(streams->streams[j].ring);
+      }
+      free(streams);
+      return false;
+    }
+  }
+  atomic_store(&streams->running, true);
+  if (pthread_create(&streams->thread, NULL, stream_thread, streams) != 0) {
+    fprintf(stderr, "Could not start sample prefetch thread\n");
+    for (int i = 0; i < NULL_STREAM_COUNT; i++) {
+      soundio_ring_buffer_destroy(streams->streams[i].ring);
+    }
+    free(streams);
+    return false;
+  }
+  manager->streams = streams;
+  return true;
+}
+
+// stop prefetching, and free the streams
+void null_streams_free(NullStreams* streams) {
+  if (streams == NULL) {
+    return;
+  }
+  atomic_store(&streams->running, false);
+  pthread_join(streams->thread, NULL);
+  for (int i = 0; i < NULL_STREAM_COUNT; i++) {
+    soundio_ring_buffer_destroy(streams->streams[i].ring);
+  }
+  free(streams);
+}
+
+// reads that had to wait on the mapped file, because nothing was prefetched for them
+unsigned int null_streams_misses(NullStreams* streams) {
+  return streams == NULL ? 0 : atomic_load(&streams->misses);
+}
+
+// keep the head of a mapped sample file in RAM, and stream the rest (if it's bigger than that)
+void null_sample_stream(NullUnitManager* manager, NullUnitSample* sample) {
+  if ((size_t)sample->len <= NULL_SAMPLE_HEAD || !streams_start(manager)) {
+    return;
+  }
+  sample->head = malloc(NULL_SAMPLE_HEAD);
+  memcpy(sample->head, sample->data, NULL_SAMPLE_HEAD);
+  sample->head_len = NULL_SAMPLE_HEAD;
+}
+
+// find the stream of the voice that is reading from offset (or start one), NULL if there is none
+static NullStream* stream_find(NullUnit* unit, unsigned int id, size_t offset, size_t count) {
+  NullStreams* streams = unit->manager->streams;
+  for (int i = 0; i < NULL_STREAM_COUNT; i++) {
+    NullStream* stream = &streams->streams[i];
+    int expected = NULL_STREAM_ACTIVE;
+    if (atomic_load_explicit(&stream->unit, memory_order_relaxed) != unit->id || atomic_load_explicit(&stream->sample, memory_order_relaxed) != id) {
+      continue;
+    }
+    if (atomic_compare_exchange_strong(&stream->state, &expected, NULL_STREAM_READING)) {
+      if (stream->unit == unit->id && stream->sample == id && offset >= stream->last && offset <= stream->pos) {
+        return stream;
+      }
+      atomic_store_explicit(&stream->state, NULL_STREAM_ACTIVE, memory_order_release);
+    }
+  }
+
+  // a new voice (or one that jumped): its stream starts here, or after the head, which it's read from till then
+  size_t head = unit->manager->samples[id].head_len / sizeof(float);
+  for (int i = 0; i < NULL_STREAM_COUNT; i++) {
+    NullStream* stream = &streams->streams[i];
+    int expected = NULL_STREAM_FREE;
+    if (atomic_compare_exchange_strong(&stream->state, &expected, NULL_STREAM_CLAIMED)) {
+      stream->unit = unit->id;
+      stream->sample = id;
+      stream->last = offset;
+      stream->pos = offset;
+      stream->start = offset > head ? offset + count : head;
+      stream->fill = stream->start;
+      atomic_store_explicit(&stream->used, atomic_load_explicit(&unit->manager->frames, memory_order_relaxed), memory_order_relaxed);
+      atomic_store_explicit(&stream->state, NULL_STREAM_READING, memory_order_release);
+      return stream;
+    }
+  }
+  return NULL;
+}
+
+// copy count floats of a sample (from offset) into dest, from RAM, a voice's stream, or the mapped file
+// past the end of the sample is silence
+void null_sample_read(NullUnit* unit, unsigned int id, size_t offset, size_t count, float* dest) {
+  NullUnitManager* manager = unit->manager;
+  NullUnitSample* sample = &manager->samples[id];
+  size_t len = sample->len / sizeof(float);
+  size_t available = offset < len ? len - offset : 0;
+  size_t total = count < available ? count : available;
+  memset(dest + total, 0, (count - total) * sizeof(float));
+
+  if (sample->head == NULL) {
+    memcpy(dest, sample->data + offset, total * sizeof(float));
+    return;
+  }
+
+  size_t head = sample->head_len / sizeof(float);
+  size_t done = 0;
+  if (offset < head) {
+    done = head - offset < total ? head - offset : total;
+    memcpy(dest, sample->head + offset, done * sizeof(float));
+  }
+  NullStream* stream = stream_find(unit, id, offset, count);
+  if (stream == NULL) {
+    if (done < total) {
+      atomic_fetch_add_explicit(&manager->streams->misses, 1, memory_order_relaxed);
+      memcpy(dest + done, sample->data + offset + done, (total - done) * sizeof(float));
+    }
+    return;
+  }
+
+  // skip what the voice has gone past, then take what is there
+  size_t from = offset + done;
+  size_t filled = soundio_ring_buffer_fill_count(stream->ring) / sizeof(float);
+  if (from > stream->start) {
+    size_t skip = from - stream->start < filled ? from - stream->start : filled;
+    soundio_ring_buffer_advance_read_ptr(stream->ring, (int)(skip * sizeof(float)));
+    stream->start += skip;
+    filled -= skip;
+  }
+  if (done < total && from >= stream->start && from < stream->start + filled) {
+    size_t ready = stream->start + filled - from;
+    size_t n = total - done < ready ? total - done : ready;
+    memcpy(dest + done, soundio_ring_buffer_read_ptr(stream->ring), n * sizeof(float));
+    done += n;
+  }
+  if (done < total) {
+    atomic_fetch_add_explicit(&manager->streams->misses, 1, memory_order_relaxed);
+    memcpy(dest + done, sample->data + offset + done, (total - done) * sizeof(float));
+  }
+
+  stream->last = offset;
+  stream->pos = offset + count;
+  atomic_store_explicit(&stream->used, atomic_load_explicit(&manager->frames, memory_order_relaxed), memory_order_relaxed);
+  atomic_store_explicit(&stream->state, NULL_STREAM_ACTIVE, memory_order_release);
+}
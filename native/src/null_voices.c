@@ -0,0 +1,115 @@
+// voice groups: units keep their state in statics, so polyphony is N copies of a unit (or a chain of them).
+// they are all loaded and connected when the group is made, into a built-in unit that mixes them (the group's id).
+// notes go to the audio thread like any command, and it gives them to free voices (or steals one), so nothing is
+// made at note time. a voice that is idle (no note, and done ringing out) is skipped, so it costs no DSP.
+
+#include "null_manager.h"
+
+// find what voice params a note sets, by name
+static void voices_bind(NullVoiceGroup* group, NullVoice* voice) {
+  for (unsigned int p = 0; p < group->length; p++) {
+    NullUnitnInfo* info = voice->units[p]->info;
+    for (unsigned int i = 0; i < cvector_size(info->params); i++) {
+      const char* name = info->params[i]->name;
+      NullVoiceBinding binding = { .position=p, .param=i };
+      if (strcmp(name, "note") == 0) {
+        binding.role = NULL_VOICE_NOTE;
+      } else if (strcmp(name, "trigger") == 0 || strcmp(name, "gate") == 0) {
+        binding.role = NULL_VOICE_GATE;
+        group->gated = true;
+      } else if (strcmp(name, "velocity") == 0) {
+        binding.role = NULL_VOICE_VELOCITY;
+      } else {
+        continue;
+      }
+      group->bindings = realloc(group->bindings, (group->binding_count + 1) * sizeof(NullVoiceBinding));
+      group->bindings[group->binding_count++] = binding;
+    }
+  }
+}
+
+// make a voice group
+unsigned int null_manager_voices(NullUnitManager* manager, const char** names, unsigned int nameCount, unsigned int count, NullVoiceSteal steal) {
+  if (nameCount == 0 || count == 0) {
+    return NULL_UNIT_INVALID;
+  }
+  NullVoiceGroup* group = calloc(1, sizeof(NullVoiceGroup));
+  group->voices = calloc(count, sizeof(NullVoice));
+  group->voice_count = count;
+  group->length = nameCount;
+  group->steal = steal;
+  for (unsigned int v = 0; v < count; v++) {
+    group->voices[v].units = calloc(nameCount, sizeof(NullUnit*));
+    group->voices[v].note = -1;
+  }
+
+  unsigned int groupId = cvector_size(manager->units);
+  pthread_mutex_lock(&manager->unit_lock);
+  NullUnit* mix = null_unit_builtin(manager, NULL_UNIT_VOICES, "voices", 1, 1);
+  pthread_mutex_unlock(&manager->unit_lock);
+  mix->id = groupId;
+  mix->group = group;
+  cvector_push_back(manager->units, mix);
+
+  // it all goes live together, with one compile
+  null_manager_batch_begin(manager);
+  for (unsigned int v = 0; v < count; v++) {
+    NullVoice* voice = &group->voices[v];
+    unsigned int previous = NULL_UNIT_INVALID;
+    for (unsigned int p = 0; p < nameCount; p++) {
+      unsigned int unitId = null_manager_load(manager, names[p]);
+      if (unitId == NULL_UNIT_INVALID) {
+        fprintf(stderr, "Could not make voice group, %s did not load\n", names[p]);
+        null_manager_unload(manager, groupId);
+        null_manager_batch_end(manager);
+        return NULL_UNIT_INVALID;
+      }
+      voice->units[p] = manager->units[unitId];
+      voice->units[p]->voice = voice;
+      if (previous != NULL_UNIT_INVALID) {
+        null_manager_connect(manager, previous, 0, unitId, 0);
+      }
+      previous = unitId;
+    }
+    null_manager_connect(manager, previous, 0, groupId, 0);
+  }
+  voices_bind(group, &group->voices[0]);
+  null_manager_batch_end(manager);
+  return groupId;
+}
+
+// get a voice group by its id, or NULL
+static NullVoiceGroup* voices_get(NullUnitManager* manager, unsigned int groupId) {
+  if (groupId >= cvector_size(manager->units) || manager->units[groupId] == NULL) {
+    return NULL;
+  }
+  return manager->units[groupId]->group;
+}
+
+// start (or stop) a note on a voice group
+void null_manager_note(NullUnitManager* manager, unsigned int groupId, unsigned int note, float velocity) {
+  if (voices_get(manager, groupId) == NULL) {
+    fprintf(stderr, "Unit %u is not a voice group\n", groupId);
+    return;
+  }
+  NullCommand command = {
+    .type = NULL_COMMAND_NOTE,
+    .unit = manager->units[groupId],
+    .param = note,
+    .value = { .f=velocity }
+  };
+  null_manager_send(manager, &command);
+}
+
+// set a param of the unit at position in every voice of a group
+void null_manager_voices_param(NullUnitManager* manager, unsigned int groupId, unsigned int position, unsigned int paramId, NullUnitParamValue value, float timefromNowInSeconds) {
+  NullVoiceGroup* group = voices_get(manager, groupId);
+  if (group == NULL || position >= group->length) {
+    return;
+  }
+  null_manager_batch_begin(manager);
+  for (unsigned int v = 0; v < group->voice_count; v++) {
+    null_manager_set_param(manager, group->voices[v].units[position]->id, paramId, value, timefromNowInSeconds);
+  }
+  null_manager_batch_end(manager);
+}
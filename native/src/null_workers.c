@@ -0,0 +1,290 @@
+// pool of pinned worker threads that render independent nodes of a plan in parallel
+// each block, every node gets a counter of the nodes it waits for, and whoever finishes the last of those
+// pushes it on their own work-stealing deque. the audio thread works too, and waits for the rest
+
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <sched.h>
+#include "null_manager.h"
+
+#ifdef __APPLE__
+#include <dispatch/dispatch.h>
+typedef dispatch_semaphore_t NullSemaphore;
+#define null_semaphore_init(s) (*(s) = dispatch_semaphore_create(0))
+#define null_semaphore_wait(s) dispatch_semaphore_wait(*(s), DISPATCH_TIME_FOREVER)
+#define null_semaphore_post(s) dispatch_semaphore_signal(*(s))
+#define null_semaphore_destroy(s) dispatch_release(*(s))
+#else
+#include <semaphore.h>
+typedef sem_t NullSemaphore;
+#define null_semaphore_init(s) sem_init((s), 0, 0)
+#define null_semaphore_wait(s) while (sem_wait(s) != 0) {}
+#define null_semaphore_post(s) sem_post(s)
+#define null_semaphore_destroy(s) sem_destroy(s)
+#endif
+
+// how long an idle worker spins before it sleeps
+#define NULL_WORKER_SPINS 20000
+
+// Chase-Lev deque: owner pushes/takes at bottom, thieves steal from top
+typedef struct {
+  _Alignas(64) _Atomic int64_t top;
+  _Alignas(64) _Atomic int64_t bottom;
+  atomic_uint items[NULL_WORKER_DEQUE_SIZE];
+} NullWorkerDeque;
+
+typedef struct {
+  NullWorkers* pool;
+  unsigned int index;
+  pthread_t thread;
+  atomic_bool sleeping;
+  NullSemaphore wake;
+  uint32_t seed; // for picking who to steal from
+  NullWorkerDeque deque;
+} NullWorker;
+
+struct NullWorkers {
+  NullUnitManager* manager;
+  NullWorker* workers; // workers[0] is the audio thread
+  unsigned int count;
+  atomic_bool running;
+  _Alignas(64) atomic_uint generation; // bumped for every block
+  _Alignas(64) atomic_uint remaining; // nodes left to run this block
+
+  // current block, set before any node is pushed
+  NullUnitPlan* plan;
+  uint64_t block_start;
+  unsigned int frames;
+};
+
+static inline void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  __asm__ volatile("yield");
+#endif
+}
+
+// owner: add a node
+static void deque_push(NullWorkerDeque* deque, unsigned int node) {
+  int64_t bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed);
+  atomic_store_explicit(&deque->items[bottom & (NULL_WORKER_DEQUE_SIZE - 1)], node, memory_order_relaxed);
+  atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_release);
+}
+
+// owner: take the newest node, false if empty
+static bool deque_take(NullWorkerDeque* deque, unsigned int* node) {
+  int64_t bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed) - 1;
+  atomic_store_explicit(&deque->bottom, bottom, memory_order_relaxed);
+  atomic_thread_fence(memory_order_seq_cst);
+  int64_t top = atomic_load_explicit(&deque->top, memory_order_relaxed);
+  if (top > bottom) {
+    atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+    return false;
+  }
+  *node = atomic_load_explicit(&deque->items[bottom & (NULL_WORKER_DEQUE_SIZE - 1)], memory_order_relaxed);
+  if (top == bottom) {
+    // last one, race thieves for it
+    bool won = atomic_compare_exchange_strong_explicit(&deque->top, &top, top + 1, memory_order_seq_cst, memory_order_relaxed);
+    atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+    return won;
+  }
+  return true;
+}
+
+// thief: take the oldest node, false if empty (or someone else got it)
+static bool deque_steal(NullWorkerDeque* deque, unsigned int* node) {
+  int64_t top = atomic_load_explicit(&deque->top, memory_order_acquire);
+  atomic_thread_fence(memory_order_seq_cst);
+  int64_t bottom = atomic_load_explicit(&deque->bottom, memory_order_acquire);
+  if (top >= bottom) {
+    return false;
+  }
+  *node = atomic_load_explicit(&deque->items[top & (NULL_WORKER_DEQUE_SIZE - 1)], memory_order_relaxed);
+  return atomic_compare_exchange_strong_explicit(&deque->top, &top, top + 1, memory_order_seq_cst, memory_order_relaxed);
+}
+
+// run a node, then push whatever it was the last dependency of
+static void run_node(NullWorkers* pool, NullWorker* worker, unsigned int index) {
+  NullUnitPlan* plan = pool->plan;
+  NullUnitPlanNode* node = &plan->nodes[index];
+  null_manager_render_node(pool->manager, node, pool->block_start, pool->frames);
+  for (unsigned int d = 0; d < node->dependent_count; d++) {
+    NullUnitPlanNode* dependent = &plan->nodes[node->dependents[d]];
+    if (atomic_fetch_sub_explicit(&dependent->pending, 1, memory_order_acq_rel) == 1) {
+      deque_push(&worker->deque, node->dependents[d]);
+    }
+  }
+  atomic_fetch_sub_explicit(&pool->remaining, 1, memory_order_acq_rel);
+}
+
+// run nodes (own first, then stolen) until the block is done
+static void work(NullWorkers* pool, NullWorker* worker) {
+  unsigned int node;
+  while (atomic_load_explicit(&pool->remaining, memory_order_acquire) > 0) {
+    if (deque_take(&worker->deque, &node)) {
+      run_node(pool, worker, node);
+      continue;
+    }
+    worker->seed ^= worker->seed << 13;
+    worker->seed ^= worker->seed >> 17;
+    worker->seed ^= worker->seed << 5;
+    unsigned int victim = worker->seed % pool->count;
+    bool stole = false;
+    for (unsigned int i = 0; i < pool->count && !stole; i++) {
+      unsigned int v = (victim + i) % pool->count;
+      if (v != worker->index) {
+        stole = deque_steal(&pool->workers[v].deque, &node);
+      }
+    }
+    if (stole) {
+      run_node(pool, worker, node);
+    } else {
+      cpu_relax();
+    }
+  }
+}
+
+void null_workers_thread_init(void) {
+  static _Thread_local bool ready = false;
+  if (!ready) {
+    ready = true;
+    if (!wasm_runtime_init_thread_env()) {
+      fprintf(stderr, "Could not set up wasm runtime for render thread\n");
+    }
+  }
+}
+
+static void* worker_thread(void* arg) {
+  NullWorker* worker = (NullWorker*)arg;
+  NullWorkers* pool = worker->pool;
+  null_workers_thread_init();
+  null_realtime_thread(pool->manager, worker->index);
+
+  unsigned int seen = atomic_load(&pool->generation);
+  while (true) {
+    // wait for a block: spin a bit (blocks come often), then sleep until audio thread wakes us
+    unsigned int spins = 0;
+    // (a worker that starts late can miss the generation bump that stops it, so it checks running too)
+    while (atomic_load(&pool->generation) == seen && atomic_load(&pool->running)) {
+      if (spins++ < NULL_WORKER_SPINS) {
+        cpu_relax();
+        continue;
+      }
+      atomic_store(&worker->sleeping, true);
+      if (atomic_load(&pool->generation) == seen && atomic_load(&pool->running)) {
+        null_semaphore_wait(&worker->wake);
+      }
+      atomic_store(&worker->sleeping, false);
+    }
+    seen = atomic_load(&pool->generation);
+    if (!atomic_load(&pool->running)) {
+      break;
+    }
+    work(pool, worker);
+  }
+
+  wasm_runtime_destroy_thread_env();
+  return NULL;
+}
+
+void null_manager_set_threads(NullUnitManager* manager, unsigned int threads) {
+  if (atomic_load(&manager->workers) != NULL) {
+    fprintf(stderr, "Render threads are already set\n");
+    return;
+  }
+
+  if (threads == 0) {
+    threads = null_realtime_cores();
+  }
+  if (threads < 2) {
+    // just the audio thread
+    return;
+  }
+
+  NullWorkers* pool = calloc(1, sizeof(NullWorkers));
+  pool->manager = manager;
+  pool->count = threads;
+  pool->workers = aligned_alloc(64, ((threads * sizeof(NullWorker)) + 63) & ~(size_t)63);
+  memset(pool->workers, 0, threads * sizeof(NullWorker));
+  atomic_init(&pool->running, true);
+  atomic_init(&pool->generation, 0);
+  atomic_init(&pool->remaining, 0);
+
+  for (unsigned int i = 0; i < threads; i++) {
+    NullWorker* worker = &pool->workers[i];
+    worker->pool = pool;
+    worker->index = i;
+    worker->seed = 0x9e3779b9u * (i + 1);
+    atomic_init(&worker->sleeping, false);
+    atomic_init(&worker->deque.top, 0);
+    atomic_init(&worker->deque.bottom, 0);
+    null_semaphore_init(&worker->wake);
+  }
+
+  // workers[0] is whatever thread calls null_workers_render
+  unsigned int started = 1;
+  for (unsigned int i = 1; i < threads; i++) {
+    NullWorker* worker = &pool->workers[i];
+    if (pthread_create(&worker->thread, NULL, worker_thread, worker) != 0) {
+      fprintf(stderr, "Could not start render worker %u\n", i);
+      break;
+    }
+    started++;
+  }
+  for (unsigned int i = started; i < threads; i++) {
+    null_semaphore_destroy(&pool->workers[i].wake);
+  }
+  pool->count = started;
+  if (started < 2) {
+    null_workers_free(pool);
+    return;
+  }
+
+  printf("rendering with %u threads\n", started);
+  atomic_store_explicit(&manager->workers, pool, memory_order_release);
+}
+
+void null_workers_render(NullWorkers* pool, NullUnitPlan* plan, uint64_t blockStart, unsigned int frames) {
+  pool->plan = plan;
+  pool->block_start = blockStart;
+  pool->frames = frames;
+
+  NullWorker* self = &pool->workers[0];
+  atomic_store_explicit(&pool->remaining, plan->node_count, memory_order_relaxed);
+  for (unsigned int n = 0; n < plan->node_count; n++) {
+    atomic_store_explicit(&plan->nodes[n].pending, plan->nodes[n].dependency_count, memory_order_relaxed);
+  }
+  for (unsigned int n = 0; n < plan->node_count; n++) {
+    if (plan->nodes[n].dependency_count == 0) {
+      deque_push(&self->deque, n);
+    }
+  }
+
+  // wake up anyone that went to sleep
+  atomic_fetch_add(&pool->generation, 1);
+  for (unsigned int i = 1; i < pool->count; i++) {
+    if (atomic_exchange(&pool->workers[i].sleeping, false)) {
+      null_semaphore_post(&pool->workers[i].wake);
+    }
+  }
+
+  work(pool, self);
+}
+
+void null_workers_free(NullWorkers* pool) {
+  if (pool == NULL) {
+    return;
+  }
+  atomic_store(&pool->running, false);
+  atomic_fetch_add(&pool->generation, 1);
+  for (unsigned int i = 1; i < pool->count; i++) {
+    null_semaphore_post(&pool->workers[i].wake);
+    pthread_join(pool->workers[i].thread, NULL);
+  }
+  for (unsigned int i = 0; i < pool->count; i++) {
+    null_semaphore_destroy(&pool->workers[i].wake);
+  }
+  free(pool->workers);
+  free(pool);
+}
@@ -0,0 +1,71 @@
+// xruns: libsoundio says when the device underflowed, and that is noted (on whatever thread it calls from, so
+// without blocking or allocating) along with the last block's render time, the graph size, and the last command
+// the audio thread applied. the control thread picks them up, reports them on stderr, and keeps the recent ones
+// to send over OSC, so dropouts can be lined up with patch changes.
+
+#include "null_manager.h"
+
+// name of a command type
+const char* null_command_name(NullCommandType type) {
+  switch (type) {
+    case NULL_COMMAND_PLAN:
+      return "plan";
+    case NULL_COMMAND_SET_PARAM:
+      return "param";
+    case NULL_COMMAND_RAMP:
+      return "ramp";
+    case NULL_COMMAND_UNLOAD:
+      return "unload";
+    case NULL_COMMAND_NOTE:
+      return "note";
+  }
+  return "unknown";
+}
+
+// device underflowed: note it, with what the audio thread was doing (called from libsoundio)
+void null_xrun_record(NullUnitManager* manager) {
+  atomic_fetch_add_explicit(&manager->xrun_count, 1, memory_order_relaxed);
+
+  // if control thread is behind, this one is only counted
+  unsigned int head = atomic_load_explicit(&manager->xrun_head, memory_order_relaxed);
+  unsigned int tail = atomic_load_explicit(&manager->xrun_tail, memory_order_acquire);
+  if (head - tail >= NULL_XRUN_RECENT) {
+    return;
+  }
+  NullXrun* xrun = &manager->xrun_ring[head % NULL_XRUN_RECENT];
+  xrun->frame = atomic_load_explicit(&manager->frames, memory_order_relaxed);
+  xrun->render_ns = atomic_load_explicit(&manager->last_render_ns, memory_order_relaxed);
+  xrun->render_frames = atomic_load_explicit(&manager->last_render_frames, memory_order_relaxed);
+  xrun->nodes = atomic_load_explicit(&manager->last_render_nodes, memory_order_relaxed);
+  xrun->command = (NullCommandType)atomic_load_explicit(&manager->last_command, memory_order_relaxed);
+  xrun->command_unit = atomic_load_explicit(&manager->last_command_unit, memory_order_relaxed);
+  xrun->command_frame = atomic_load_explicit(&manager->last_command_frame, memory_order_relaxed);
+  atomic_store_explicit(&manager->xrun_head, head + 1, memory_order_release);
+}
+
+// control thread: take xruns from the audio thread, report them on stderr, and keep the recent ones
+void null_xruns_collect(NullUnitManager* manager) {
+  unsigned int tail = atomic_load_explicit(&manager->xrun_tail, memory_order_relaxed);
+  unsigned int head = atomic_load_explicit(&manager->xrun_head, memory_order_acquire);
+  double rate = manager->sample_rate;
+  for (; tail != head; tail++) {
+    NullXrun* xrun = &manager->xrun_ring[tail % NULL_XRUN_RECENT];
+    double budget = xrun->render_frames > 0 ? xrun->render_frames * 1000.0 / rate : 0.0;
+    fprintf(stderr, "xrun at %.3fs: last block took %.3fms (of %.3fms), %u units, last command %s (unit %d) %.3fs before\n", xrun->frame / rate, xrun->render_ns / 1e6, budget, xrun->nodes, null_command_name(xrun->command), xrun->command_unit == NULL_UNIT_INVALID ? -1 : (int)xrun->command_unit, (double)(xrun->frame - xrun->command_frame) / rate);
+    manager->xrun_recent[manager->xrun_recent_next] = *xrun;
+    manager->xrun_recent_next = (manager->xrun_recent_next + 1) % NULL_XRUN_RECENT;
+    if (manager->xrun_recent_count < NULL_XRUN_RECENT) {
+      manager->xrun_recent_count++;
+    }
+  }
+  atomic_store_explicit(&manager->xrun_tail, tail, memory_order_release);
+}
+
+// control thread: recent xrun i (0 is the oldest kept), NULL past the end
+NullXrun* null_xrun_recent(NullUnitManager* manager, unsigned int i) {
+  if (i >= manager->xrun_recent_count) {
+    return NULL;
+  }
+  unsigned int oldest = (manager->xrun_recent_next + NULL_XRUN_RECENT - manager->xrun_recent_count) % NULL_XRUN_RECENT;
+  return &manager->xrun_recent[(oldest + i) % NULL_XRUN_RECENT];
+}
@@ -0,0 +1,236 @@
+// benchmark of the units in a dir: each is fed the same noise for some seconds of audio, with each ABI it has
+// (process_block, and process() once per sample), on each WAMR tier that is built. results are JSON on stdout, so
+// releases can be compared (anything else that gets printed goes to stderr).
+
+#include <getopt.h>
+#include <inttypes.h>
+#include "null_manager.h"
+
+typedef struct {
+  const char* name;
+  NullUnitEngine engine;
+} BenchTier;
+
+typedef struct {
+  FILE* out;
+  double seconds;
+  unsigned int sample_rate;
+  unsigned int channels;
+  unsigned int block;
+  bool first; // no result written yet
+} Bench;
+
+// noise in -1..1, same every run for the same seed (xorshift32)
+static float bench_noise(uint32_t* seed) {
+  uint32_t x = *seed;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  *seed = x;
+  return (float)((double)x / 2147483648.0 - 1.0);
+}
+
+// write a JSON string (unit names are file names, so this only needs the basics)
+static void bench_string(FILE* out, const char* s) {
+  fputc('"', out);
+  for (; *s != '\0'; s++) {
+    if (*s == '"' || *s == '\\') {
+      fputc('\\', out);
+    } else if ((unsigned char)*s < 0x20) {
+      fprintf(out, "\\u%04x", *s);
+      continue;
+    }
+    fputc(*s, out);
+  }
+  fputc('"', out);
+}
+
+// start a result object (the caller writes the rest of it, and closes it)
+static void bench_result(Bench* bench, const char* unit, const char* tier, const char* abi) {
+  fprintf(bench->out, "%s\n    {\"unit\": ", bench->first ? "" : ",");
+  bench->first = false;
+  bench_string(bench->out, unit);
+  fprintf(bench->out, ", \"tier\": \"%s\", \"abi\": \"%s\"", tier, abi);
+}
+
+// is a unit running compiled code (from an .aot)?
+static bool bench_is_aot(NullUnit* unit) {
+  size_t len = strlen(unit->module->path);
+  return len > 4 && strcmp(unit->module->path + len - 4, ".aot") == 0;
+}
+
+// run a unit (fresh) with one ABI for bench->seconds of noise
+static void bench_unit(Bench* bench, NullUnitManager* manager, const BenchTier* tier, const char* name, bool perSample) {
+  const char* abi = perSample ? "sample" : "block";
+  NullUnit* unit = null_unit_create(manager, name, 1);
+  if (unit == NULL) {
+    bench_result(bench, name, tier->name, abi);
+    fprintf(bench->out, ", \"error\": \"did not load\"}");
+    return;
+  }
+  if (!perSample && unit->fn_process_block == NULL) {
+    // older unit, it only has process()
+    null_unit_free(unit);
+    return;
+  }
+  if (tier->engine == NULL_ENGINE_AOT && !bench_is_aot(unit)) {
+    bench_result(bench, name, tier->name, abi);
+    fprintf(bench->out, ", \"error\": \"no .aot\"}");
+    null_unit_free(unit);
+    return;
+  }
+  if (perSample) {
+    unit->fn_process_block = NULL;
+  }
+  unit->in_app = unit->block_in;
+
+  unsigned int channels = bench->channels;
+  uint64_t total = (uint64_t)(bench->seconds * bench->sample_rate);
+  uint64_t frames = 0;
+  uint64_t blocks = 0;
+  uint64_t ns = 0;
+  bool trapped = false;
+  uint32_t seed = 0x9e3779b9;
+  while (frames < total) {
+    // noise isn't timed, only the unit
+    float* in = null_unit_block_in(unit);
+    for (unsigned int i = 0; i < bench->block * channels; i++) {
+      in[i] = bench_noise(&seed);
+    }
+    uint64_t start = null_stats_now();
+    bool ok = null_unit_process(unit, 0, bench->block, channels, (float)bench->sample_rate, (double)frames / bench->sample_rate);
+    ns += null_stats_now() - start;
+    if (!ok) {
+      trapped = true;
+      break;
+    }
+    frames += bench->block;
+    blocks++;
+  }
+
+  // pages it ended up with, after growing (64KiB each)
+  wasm_memory_inst_t memory = wasm_runtime_get_default_memory(unit->module_inst);
+  uint64_t pages = memory != NULL ? wasm_memory_get_cur_page_count(memory) : 0;
+
+  uint64_t samples = frames * channels;
+  uint64_t calls = perSample ? samples : blocks;
+  double seconds = ns > 0 ? ns / 1e9 : 1e-9;
+  bench_result(bench, name, tier->name, abi);
+  fprintf(bench->out, ", \"frames\": %" PRIu64 ", \"ns_per_sample\": %.3f, \"calls\": %" PRIu64 ", \"calls_per_sec\": %.1f, \"realtime\": %.2f, \"pages\": %" PRIu64, frames, samples > 0 ? (double)ns / samples : 0.0, calls, calls / seconds, ((double)frames / bench->sample_rate) / seconds, pages);
+  if (trapped) {
+    fprintf(bench->out, ", \"error\": \"trapped after %" PRIu64 " frames\"", frames);
+  }
+  fprintf(bench->out, "}");
+  null_unit_free(unit);
+}
+
+// AOT: units found without an .aot get one compiled into the cache, so wait for those
+static void bench_aot_wait(NullUnitManager* manager) {
+  if (null_aot_cache_idle(manager->aot_cache)) {
+    return;
+  }
+  fprintf(stderr, "waiting for wamrc to compile units...\n");
+  while (!null_aot_cache_idle(manager->aot_cache)) {
+    usleep(100000);
+  }
+}
+
+// run every unit in dir on a tier, false if the tier isn't built
+static bool bench_tier(Bench* bench, const BenchTier* tier, const char* dir) {
+  // a manager each, since it sets up (and tears down) WAMR for its engine
+  NullUnitManager* manager = null_manager_create_offline(bench->sample_rate, bench->channels, bench->block);
+  if (manager == NULL) {
+    return false;
+  }
+  if (!null_manager_set_engine(manager, tier->engine)) {
+    null_manager_destroy(manager);
+    return false;
+  }
+  null_manager_get_units(manager, dir);
+  if (tier->engine == NULL_ENGINE_AOT) {
+    bench_aot_wait(manager);
+  }
+  for (size_t i = 0; i < cvector_size(manager->available_units); i++) {
+    // built-ins have no path
+    const char* name = manager->available_units[i].name;
+    if (manager->available_units[i].path == NULL) {
+      continue;
+    }
+    fprintf(stderr, "%s: %s\n", tier->name, name);
+    bench_unit(bench, manager, tier, name, false);
+    bench_unit(bench, manager, tier, name, true);
+  }
+  null_manager_destroy(manager);
+  return true;
+}
+
+static void usage(const char* name) {
+  fprintf(stderr, "Usage: %s [-s seconds] [-R rate] [-B block] [-C channels] [dir]\n", name);
+  fprintf(stderr, "Run every unit in dir (docs/units by default) on every WAMR tier that is built, and print JSON results\n");
+}
+
+int main(int argc, char* argv[]) {
+  Bench bench = {
+    .seconds = 10.0,
+    .sample_rate = SAMPLE_RATE,
+    .channels = NULL_MAX_CHANNELS,
+    .block = FRAMES_PER_BUFFER,
+    .first = true
+  };
+  int opt;
+  while ((opt = getopt(argc, argv, "s:R:B:C:h")) != -1) {
+    switch (opt) {
+      case 's':
+        bench.seconds = atof(optarg);
+        break;
+      case 'R':
+        bench.sample_rate = (unsigned int)atoi(optarg);
+        break;
+      case 'B':
+        bench.block = (unsigned int)atoi(optarg);
+        break;
+      case 'C':
+        bench.channels = (unsigned int)atoi(optarg);
+        break;
+      default:
+        usage(argv[0]);
+        return opt == 'h' ? 0 : 1;
+    }
+  }
+  if (bench.seconds <= 0.0 || bench.sample_rate == 0 || bench.block == 0 || bench.block > NULL_MAX_BLOCK || bench.channels == 0 || bench.channels > NULL_MAX_CHANNELS) {
+    usage(argv[0]);
+    return 1;
+  }
+  const char* dir = optind < argc ? argv[optind] : "docs/units";
+
+  // JSON gets stdout to itself: what the engine (or a unit) prints goes to stderr
+  fflush(stdout);
+  bench.out = fdopen(dup(STDOUT_FILENO), "w");
+  dup2(STDERR_FILENO, STDOUT_FILENO);
+  if (bench.out == NULL) {
+    fprintf(stderr, "Could not open stdout\n");
+    return 1;
+  }
+
+  BenchTier tiers[] = {
+    { NULL_WAMR_FAST_INTERP ? "fast-interp" : "interp", NULL_WAMR_FAST_INTERP ? NULL_ENGINE_FAST_INTERP : NULL_ENGINE_INTERP },
+    { "aot", NULL_ENGINE_AOT },
+    { NULL_WAMR_JIT ? "jit" : "fast-jit", NULL_ENGINE_JIT }
+  };
+
+  fprintf(bench.out, "{\n  \"rate\": %u,\n  \"channels\": %u,\n  \"block\": %u,\n  \"seconds\": %g,\n  \"results\": [", bench.sample_rate, bench.channels, bench.block, bench.seconds);
+  cvector_vector_type(const char*) built = NULL;
+  for (size_t t = 0; t < sizeof(tiers) / sizeof(tiers[0]); t++) {
+    if (bench_tier(&bench, &tiers[t], dir)) {
+      cvector_push_back(built, tiers[t].name);
+    }
+  }
+  fprintf(bench.out, "\n  ],\n  \"tiers\": [");
+  for (size_t t = 0; t < cvector_size(built); t++) {
+    fprintf(bench.out, "%s\"%s\"", t > 0 ? ", " : "", built[t]);
+  }
+  fprintf(bench.out, "]\n}\n");
+  cvector_free(built);
+  fclose(bench.out);
+  return 0;
+}
@@ -14,7 +14,7 @@ void signal_handler(int signum) {
 int main() {
   signal(SIGINT, signal_handler);
 
-  NullUnitManager* manager = null_manager_create();
+  NullUnitManager* manager = null_manager_create(NULL);
   null_manager_get_units(manager, "docs/units");
 
   // print available units
@@ -43,7 +43,8 @@ int main() {
   printf("osc note (1) set to 60\n");
 
   while(keep_running) {
-    null_manager_process();
+    null_manager_process(manager);
+    usleep(10000);
   }
 
   null_manager_destroy(manager);
@@ -0,0 +1,71 @@
+// test of unit sleeping: osc -> adsr -> audioOut, adsr goes to sleep (so osc isn't run), then a trigger lands mid-block.
+// the adsr has to hear osc in that same block, not a block later. exits 1 if it doesn't.
+
+#include "null_manager.h"
+
+#define TEST_CHANNELS 1
+
+// render a block, and mix audioOut into out (this thread is the control thread too)
+static void test_block(NullUnitManager* manager, float* out) {
+  null_manager_render(manager, manager->block);
+  null_manager_mix_output(manager, manager->block, 0, (char*)out, TEST_CHANNELS * sizeof(float));
+  null_manager_process(manager);
+}
+
+int main(int argc, char* argv[]) {
+  const char* dir = argc > 1 ? argv[1] : "docs/units";
+  NullUnitManager* manager = null_manager_create_offline(SAMPLE_RATE, TEST_CHANNELS, FRAMES_PER_BUFFER);
+  if (manager == NULL) {
+    return 1;
+  }
+  null_manager_get_units(manager, dir);
+
+  unsigned int block = manager->block;
+  float* out = calloc(block, sizeof(float));
+  NullUnitParamValue value = {};
+
+  unsigned int osc = null_manager_load(manager, "osc");
+  unsigned int adsr = null_manager_load(manager, "adsr");
+  null_manager_connect(manager, osc, 0, adsr, 0);
+  null_manager_connect(manager, adsr, 0, 0, 0);
+  value.i = 1;
+  null_manager_set_param(manager, osc, 0, value, 0.0f);
+  value.f = 60.0f;
+  null_manager_set_param(manager, osc, 1, value, 0.0f);
+  value.f = 0.001f;
+  null_manager_set_param(manager, adsr, 1, value, 0.0f);
+
+  // idle envelope, no trigger: it sleeps after its first block
+  for (int i = 0; i < 4; i++) {
+    test_block(manager, out);
+  }
+  NullUnit* unit = adsr < cvector_size(manager->units) ? manager->units[adsr] : NULL;
+  if (unit == NULL || unit->fn_sleeping == NULL || !unit->asleep) {
+    fprintf(stderr, "adsr in %s didn't load, or doesn't sleep (rebuild units)\n", dir);
+    free(out);
+    null_manager_destroy(manager);
+    return 1;
+  }
+
+  // trigger halfway into the next block
+  unsigned int at = block / 2;
+  value.i = 1;
+  null_manager_set_param(manager, adsr, 0, value, (float)at / manager->sample_rate);
+  test_block(manager, out);
+
+  float before = 0.0f;
+  float after = 0.0f;
+  for (unsigned int i = 0; i < block; i++) {
+    if (i < at) {
+      before = fmaxf(before, fabsf(out[i]));
+    } else {
+      after = fmaxf(after, fabsf(out[i]));
+    }
+  }
+  bool ok = before == 0.0f && after > 0.0f;
+  printf("%s: silent before trigger (peak %f), sound after it in the same block (peak %f)\n", ok ? "ok" : "FAIL", before, after);
+
+  free(out);
+  null_manager_destroy(manager);
+  return ok ? 0 : 1;
+}
@@ -144,6 +144,11 @@ float process(uint8_t position, float input, uint8_t channel, float sampleRate,
     return envelope.currentLevel * input;
 }
 
+// idle, with no note: output is silent till trigger changes
+bool sleeping() {
+    return envelope.state == IDLE && !unitInfo.params[PARAM_TRIGGER].value.i;
+}
+
 NullUnitnInfo* get_info() {
     return &unitInfo;
 }
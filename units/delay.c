@@ -162,6 +162,13 @@ float process(uint8_t position, float input, uint8_t channel, float sampleRate,
     return output;
 }
 
+// echoes go on till feedback fades them out (sync quantizes to a beat or less, at 120 BPM)
+uint32_t tail(float sampleRate) {
+    float delayTime = unitInfo.params[PARAM_SYNC].value.i ? 500.0f : fminf(fmaxf(unitInfo.params[PARAM_TIME].value.f, 0.0f), 2000.0f);
+    float feedback = fminf(fmaxf(unitInfo.params[PARAM_FEEDBACK].value.f, 0.0f), 1.0f);
+    return nu_tail(delayTime * sampleRate / 1000.0f, feedback);
+}
+
 NullUnitnInfo* get_info() {
     return &unitInfo;
 }
@@ -37,6 +37,11 @@ float process(uint8_t position, float input, uint8_t channel, float sampleRate,
   return input * gain;
 }
 
+// silent in, silent out
+uint32_t tail(float sampleRate) {
+  return 0;
+}
+
 // Get info about the unit
 NullUnitnInfo* get_info() {
   return &unitInfo;
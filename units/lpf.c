@@ -62,6 +62,11 @@ float process(uint8_t position, float input, uint8_t channel, float sampleRate,
     return lastOutput[channel];
 }
 
+// filter state dies away quickly
+uint32_t tail(float sampleRate) {
+  return (uint32_t)(sampleRate * 0.1f);
+}
+
 // Get info about the unit
 NullUnitnInfo* get_info() {
   return &unitInfo;
@@ -93,6 +93,11 @@ float process(uint8_t position, float input, uint8_t channel, float sampleRate,
     return output;
 }
 
+// resonance rings for a bit
+uint32_t tail(float sampleRate) {
+  return (uint32_t)(sampleRate * 0.5f);
+}
+
 // Get info about the unit
 NullUnitnInfo* get_info() {
   return &unitInfo;
@@ -12,9 +12,25 @@
 #endif
 
 // these are exposed from host
+
+// copy length floats of a sample into out, starting offset bytes in (so float i is at offset i * 4)
+// floats past the end of the sample are 0
 __attribute__((import_module("env"), import_name("get_data_floats")))
 void get_data_floats(unsigned int id, unsigned int offset, unsigned int length, float* out);
 
+// read-only pointer to a whole sample, shared by every unit (no copy), or NULL if host can't share it
+// (then use get_data_floats)
+__attribute__((import_module("env"), import_name("get_data_ptr")))
+const float* get_data_ptr(unsigned int id);
+
+// how many floats are in a sample
+__attribute__((import_module("env"), import_name("get_data_length")))
+unsigned int get_data_length(unsigned int id);
+
+// how many channels a sample has (its floats are interleaved)
+__attribute__((import_module("env"), import_name("get_data_channels")))
+unsigned int get_data_channels(unsigned int id);
+
 // these are exposed from a unit
 
 typedef enum {
@@ -64,6 +80,30 @@ currentTime: represents the ever-increasing context time of the audio block bein
 __attribute__((export_name("process")))
 float process(uint8_t position, float input, uint8_t channel, float sampleRate, double currentTime);
 
+/*
+optional: process a whole block in one call, instead of crossing into the unit for every sample
+in/out: interleaved (frame * channels + channel) buffers in unit memory, frames * channels floats
+blockTime: currentTime of the block (same thing process gets)
+hosts use this if it's exported, and fall back to process() if it's not
+*/
+__attribute__((export_name("process_block")))
+void process_block(const float* in, float* out, uint32_t frames, uint32_t channels, float sampleRate, double blockTime);
+
+/*
+optional: how many frames output goes on for, once input is silent (delay/reverb time, at sampleRate)
+hosts stop running the unit once its input has been silent that long (till input or a param change wakes it)
+only export it if silent input really means silent output (after the tail), so not for oscillators or noise
+*/
+__attribute__((export_name("tail")))
+uint32_t tail(float sampleRate);
+
+/*
+optional: true if output is silent (whatever the input is) till a param changes, like an envelope that is idle
+hosts check it after each block, and stop running the unit (and whatever only feeds it) till a param changes
+*/
+__attribute__((export_name("sleeping")))
+bool sleeping();
+
 __attribute__((export_name("destroy")))
 void destroy();
 
@@ -152,6 +192,18 @@ void gen_bool(char* name, NullUnitParamInfo* out) {
   out->name = strdup(name);
 }
 
+// frames for a feedback loop (delayFrames long, feedback 0-1 each time around) to fade under -100dB, for tail()
+uint32_t nu_tail(float delayFrames, float feedback) {
+  float repeats = 0.0f;
+  if (feedback >= 0.9999f) {
+    repeats = 1e9f;
+  } else if (feedback > 0.0f) {
+    repeats = ceilf(logf(0.00001f) / logf(feedback));
+  }
+  float frames = delayFrames * (repeats + 1.0f);
+  return frames < 3000000.0f ? (uint32_t)frames : 3000000; // ~1 minute at 48k is plenty
+}
+
 // Sound utility functions
 float nu_sin(float x) {
   return sinf(fmod(x, 2.0f * M_PI));
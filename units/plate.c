@@ -160,6 +160,12 @@ float process(uint8_t position, float input, uint8_t channel, float sampleRate,
     return output;
 }
 
+// reverb goes on till feedback (set by size) fades the longest delay line out
+uint32_t tail(float sampleRate) {
+    float size = fminf(fmaxf(unitInfo.params[PARAM_SIZE].value.f, 0.0f), 1.0f);
+    return nu_tail((float)delayLengths[NUM_DELAYS - 1], 0.84f + (size * 0.15f));
+}
+
 NullUnitnInfo* get_info() {
     return &unitInfo;
 }
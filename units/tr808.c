@@ -464,6 +464,16 @@ NullUnitParamValue *param_get(uint8_t paramId) {
   return &unitInfo.params[paramId].value;
 }
 
+// no voice is sounding: output is silent till a note comes
+bool sleeping() {
+  for (int i = 0; i < VOICE_COUNT; i++) {
+    if (voices[i].triggered || voices[i].ampEnv >= 0.001f) {
+      return false;
+    }
+  }
+  return true;
+}
+
 float process(uint8_t position, float input, uint8_t channel, float sampleRate, double currentTime) {
   float output = 0.0f;
 
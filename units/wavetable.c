@@ -17,6 +17,20 @@ NullUnitnInfo unitInfo;
 
 float sample[SAMPLE_COUNT] = {};
 
+// current wave: shared with host, or copied into sample
+const float* wave = sample;
+
+// point at a sample from host (shared, no copy), or copy it if host can't share it
+void use_sample(unsigned int id) {
+  const float* shared = get_data_ptr(id);
+  if (shared != NULL && get_data_length(id) >= SAMPLE_COUNT) {
+    wave = shared;
+  } else {
+    get_data_floats(id, 0, SAMPLE_COUNT, sample);
+    wave = sample;
+  }
+}
+
 // called when the unit is loaded, returns the number of params it accepts
 int main(int argc, char *argv[]) {
   NullUnitParamInfo* params = malloc(PARAM_COUNT * sizeof(NullUnitParamInfo));
@@ -34,7 +48,7 @@ int main(int argc, char *argv[]) {
   unitInfo.params[PARAM_TYPE].max.i = 3; // (0-3)
 
   // setup initial sample from host
-  get_data_floats(0, 0, SAMPLE_COUNT, sample);
+  use_sample(0);
 
   return 0;
 }
@@ -52,7 +66,7 @@ float process(uint8_t position, float input, uint8_t channel, float sampleRate,
     float scaledPos = (position * cyclesPerFrame);
 
     unsigned int samplePos = (unsigned int)scaledPos % SAMPLE_COUNT;
-    return sample[samplePos];
+    return wave[samplePos];
 }
 
 // Get info about the unit
@@ -68,7 +82,7 @@ void param_set(uint8_t paramId, NullUnitParamValue* value) {
 
   // change sample
   if (paramId == PARAM_TYPE && value->i != unitInfo.params[PARAM_TYPE].value.i) {
-    get_data_floats(value->i, 0, SAMPLE_COUNT, sample);
+    use_sample(value->i);
   }
 
   unitInfo.params[paramId].value = *value;